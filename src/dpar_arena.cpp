@@ -0,0 +1,58 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include "dpar_arena.hpp"
+
+void* TickArena::Overflow::do_allocate(size_t size, size_t alignment) {
+	++allocations;
+	bytes += size;
+	return std::pmr::new_delete_resource()->allocate(size, alignment);
+}
+
+void TickArena::Overflow::do_deallocate(void* p, size_t size, size_t alignment) {
+	std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+}
+
+bool TickArena::Overflow::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+	return this == &other;
+}
+
+TickArena::TickArena(size_t initialBytes) : capacity(initialBytes), buffer(new char[initialBytes]), lastSpills(0), totalSpills(0), size(initialBytes) {
+	resource.reset(new std::pmr::monotonic_buffer_resource(buffer.get(), capacity, &overflow));
+}
+
+std::pmr::memory_resource* TickArena::begin() {
+	const size_t spilled = overflow.allocations;
+	lastSpills = (uint32_t)spilled;
+	totalSpills += spilled;
+
+	if (spilled > 0) {
+		// Room for everything the last tick used with headroom, the old resource goes first as it hands its overflow back
+		const size_t grown = (capacity + overflow.bytes) * 2;
+		resource.reset();
+		buffer.reset(new char[grown]);
+		capacity = grown;
+		size = grown;
+		resource.reset(new std::pmr::monotonic_buffer_resource(buffer.get(), capacity, &overflow));
+	}
+	else {
+		resource->release();
+	}
+
+	overflow.allocations = 0;
+	overflow.bytes = 0;
+	return resource.get();
+}
+
+uint32_t TickArena::lastTickSpills() const {
+	return lastSpills;
+}
+
+uint64_t TickArena::spills() const {
+	return totalSpills;
+}
+
+size_t TickArena::bytes() const {
+	return size;
+}
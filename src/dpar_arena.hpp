@@ -0,0 +1,58 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Monotonic arena for the scratch a tick needs while applying positions. Everything handed
+ * out is given back at once when the next tick begins, so once the buffer has grown to fit
+ * a tick the apply path stops going to the heap TeamSpeak itself allocates from
+ */
+
+#ifndef DPAR_ARENA_H
+#define DPAR_ARENA_H
+
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <stdint.h>
+
+// Starting size, grown whenever a tick doesn't fit
+#define DPAR_ARENA_INITIAL_BYTES (16 * 1024)
+
+class TickArena {
+	/* Heap behind the arena, counting what a tick had to take from it */
+	class Overflow : public std::pmr::memory_resource {
+		public:
+			size_t allocations;
+			size_t bytes;
+
+			Overflow() : allocations(0), bytes(0) {}
+
+		protected:
+			virtual void* do_allocate(size_t size, size_t alignment);
+			virtual void do_deallocate(void* p, size_t size, size_t alignment);
+			virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept;
+	};
+
+	size_t capacity;
+	std::unique_ptr<char[]> buffer;
+	Overflow overflow;
+	std::unique_ptr<std::pmr::monotonic_buffer_resource> resource;
+
+	// Read from the info panel
+	std::atomic<uint32_t> lastSpills;
+	std::atomic<uint64_t> totalSpills;
+	std::atomic<size_t> size;
+
+	public:
+		explicit TickArena(size_t initialBytes);
+
+		// Gives back everything from the last tick and returns the resource for this one.
+		// If the last tick spilled onto the heap the buffer grows to fit it
+		std::pmr::memory_resource* begin();
+
+		// Heap allocations the last tick needed beyond the buffer, 0 once the arena has settled
+		uint32_t lastTickSpills() const;
+		uint64_t spills() const;
+		size_t bytes() const;
+};
+
+#endif
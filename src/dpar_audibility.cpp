@@ -0,0 +1,65 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "dpar_audibility.hpp"
+
+ChannelSet::ChannelSet(std::pmr::memory_resource* resource) : others(resource) {
+	memset(words, 0, sizeof(words));
+}
+
+void ChannelSet::clear() {
+	memset(words, 0, sizeof(words));
+	others.clear();
+}
+
+void ChannelSet::insert(int32_t channel) {
+	if (channel < 0 || channel >= DPAR_MAX_GAME_CHANNELS) {
+		others.insert(channel);
+		return;
+	}
+	words[channel >> 6] |= (uint64_t)1 << (channel & 63);
+}
+
+bool ChannelSet::contains(int32_t channel) const {
+	if (channel < 0 || channel >= DPAR_MAX_GAME_CHANNELS) {
+		return others.count(channel) != 0;
+	}
+	return (words[channel >> 6] >> (channel & 63)) & 1;
+}
+
+AudibilityMask::AudibilityMask() {
+	for (int i = 0; i < DPAR_MAX_CLIENTS; ++i) {
+		silenced[i].store(false, std::memory_order_relaxed);
+	}
+}
+
+bool AudibilityMask::isSilenced(anyID clientID) const {
+	return silenced[clientID].load(std::memory_order_relaxed);
+}
+
+void AudibilityMask::update(const std::pmr::vector<anyID>& nowSilenced) {
+	next.assign(nowSilenced.begin(), nowSilenced.end());
+	std::sort(next.begin(), next.end());
+
+	// Set the new ones first so a client silenced both ticks never reads as audible in between
+	for (size_t i = 0; i < next.size(); ++i) {
+		silenced[next[i]].store(true, std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < current.size(); ++i) {
+		if (!std::binary_search(next.begin(), next.end(), current[i])) {
+			silenced[current[i]].store(false, std::memory_order_relaxed);
+		}
+	}
+	current.swap(next);
+	next.clear();
+}
+
+void AudibilityMask::reset() {
+	for (size_t i = 0; i < current.size(); ++i) {
+		silenced[current[i]].store(false, std::memory_order_relaxed);
+	}
+	current.clear();
+}
@@ -0,0 +1,57 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Which game channels the listener can hear, and which clients that leaves silenced. Talkers
+ * in a channel we can't hear are left out of the 3D placement and held at zero gain instead
+ * of being parked far above us, which kept TeamSpeak mixing them and cost float precision
+ */
+
+#ifndef DPAR_AUDIBILITY_H
+#define DPAR_AUDIBILITY_H
+
+#include <atomic>
+#include <memory_resource>
+#include <stdint.h>
+#include <unordered_set>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+#include "dpar_audio.hpp"
+
+// Game channel ids kept as bits, the ids games hand out. Any other id goes in a hashed set instead
+#define DPAR_MAX_GAME_CHANNELS 4096
+
+/* Game channels (ch.id) a listener hears, its own plus any radio or party channels it's tuned to */
+class ChannelSet {
+	uint64_t words[DPAR_MAX_GAME_CHANNELS / 64];
+	std::pmr::unordered_set<int32_t> others;  // Ids outside 0 to DPAR_MAX_GAME_CHANNELS, negative ones included
+
+	public:
+		// Out of range ids are allocated from resource, the tick arena when applying positions
+		explicit ChannelSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+		void clear();
+
+		void insert(int32_t channel);
+
+		bool contains(int32_t channel) const;
+};
+
+/* Clients silenced for being in a channel the listener can't hear, written per tick and read from the audio callbacks */
+class AudibilityMask {
+	std::atomic<bool> silenced[DPAR_MAX_CLIENTS];
+	std::vector<anyID> current;    // Sorted, set in silenced, only touched while applying positions
+	std::vector<anyID> next;       // Scratch for update, kept for its capacity
+
+	public:
+		AudibilityMask();
+
+		bool isSilenced(anyID clientID) const;
+
+		// Replaces the silenced clients with those from this tick
+		void update(const std::pmr::vector<anyID>& nowSilenced);
+
+		// Everyone audible again
+		void reset();
+};
+
+#endif
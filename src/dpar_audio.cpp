@@ -0,0 +1,160 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <string.h>
+#include "dpar_audio.hpp"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DPAR_SSE2
+#include <emmintrin.h>
+#endif
+
+ClientGainTable::ClientGainTable() {
+	for (int i = 0; i < DPAR_MAX_CLIENTS; ++i) {
+		targets[i].store(1.0f, std::memory_order_relaxed);
+		current[i] = 1.0f;
+		silent[i] = false;
+	}
+}
+
+void ClientGainTable::setTarget(anyID clientID, float gain) {
+	targets[clientID].store(gain, std::memory_order_relaxed);
+}
+
+float ClientGainTable::target(anyID clientID) const {
+	return targets[clientID].load(std::memory_order_relaxed);
+}
+
+void ClientGainTable::reset() {
+	for (int i = 0; i < DPAR_MAX_CLIENTS; ++i) {
+		targets[i].store(1.0f, std::memory_order_relaxed);
+	}
+}
+
+bool ClientGainTable::process(anyID clientID, short* samples, int sampleCount, int channels) {
+	float from = current[clientID];
+	float to = targets[clientID].load(std::memory_order_relaxed);
+	current[clientID] = to;
+
+	if (from < DPAR_SILENCE_GAIN && to < DPAR_SILENCE_GAIN) {
+		// Out of range, nothing of this frame can be heard
+		memset(samples, 0, sizeof(short) * sampleCount * channels);
+		silent[clientID] = true;
+		return false;
+	}
+
+	if (dpar_peakAbs(samples, sampleCount * channels) <= DPAR_SILENCE_PEAK) {
+		silent[clientID] = true;
+		return false;
+	}
+
+	dpar_applyGainRamp(samples, sampleCount, channels, from, to);
+	silent[clientID] = false;
+	return true;
+}
+
+bool ClientGainTable::wasSilent(anyID clientID) const {
+	return silent[clientID];
+}
+
+int dpar_peakAbs(const short* samples, int count) {
+	int peak = 0;
+	int i = 0;
+
+#ifdef DPAR_SSE2
+	__m128i high = _mm_setzero_si128();
+	__m128i low = _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+		high = _mm_max_epi16(high, v);
+		low = _mm_min_epi16(low, v);
+	}
+
+	short highs[8];
+	short lows[8];
+	_mm_storeu_si128((__m128i*)highs, high);
+	_mm_storeu_si128((__m128i*)lows, low);
+	for (int k = 0; k < 8; ++k) {
+		if (highs[k] > peak) {
+			peak = highs[k];
+		}
+		if (-lows[k] > peak) {
+			peak = -lows[k];
+		}
+	}
+#endif
+
+	for (; i < count; ++i) {
+		const int v = samples[i] < 0 ? -samples[i] : samples[i];
+		if (v > peak) {
+			peak = v;
+		}
+	}
+
+	return peak;
+}
+
+void dpar_applyGainRamp(short* samples, int sampleCount, int channels, float from, float to) {
+	if (sampleCount <= 0 || channels <= 0) {
+		return;
+	}
+
+	if (from == 1.0f && to == 1.0f) {
+		return;
+	}
+
+	if (from == 0.0f && to == 0.0f) {
+		memset(samples, 0, sizeof(short) * sampleCount * channels);
+		return;
+	}
+
+	// Gain for frame n is from + step * (n + 1) so the last frame lands exactly on the target
+	const float step = (to - from) / (float)sampleCount;
+	int frame = 0;
+
+#ifdef DPAR_SSE2
+	if (channels == 1) {
+		const __m128 lowerBound = _mm_set1_ps(-32768.0f);
+		const __m128 upperBound = _mm_set1_ps(32767.0f);
+		const __m128 gainStep = _mm_set1_ps(4.0f * step);
+		__m128 gain = _mm_setr_ps(from + step, from + 2.0f * step, from + 3.0f * step, from + 4.0f * step);
+
+		for (; frame + 8 <= sampleCount; frame += 8) {
+			__m128i in = _mm_loadu_si128((const __m128i*)(samples + frame));
+
+			// Sign extend the eight int16 samples into two vectors of int32
+			__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+			__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(in, in), 16);
+
+			__m128 flo = _mm_mul_ps(_mm_cvtepi32_ps(lo), gain);
+			gain = _mm_add_ps(gain, gainStep);
+			__m128 fhi = _mm_mul_ps(_mm_cvtepi32_ps(hi), gain);
+			gain = _mm_add_ps(gain, gainStep);
+
+			flo = _mm_min_ps(_mm_max_ps(flo, lowerBound), upperBound);
+			fhi = _mm_min_ps(_mm_max_ps(fhi, lowerBound), upperBound);
+
+			// packs saturates to the int16 range on the way back down
+			__m128i out = _mm_packs_epi32(_mm_cvtps_epi32(flo), _mm_cvtps_epi32(fhi));
+			_mm_storeu_si128((__m128i*)(samples + frame), out);
+		}
+	}
+#endif
+
+	for (; frame < sampleCount; ++frame) {
+		const float gain = from + step * (float)(frame + 1);
+		short* s = samples + frame * channels;
+
+		for (int c = 0; c < channels; ++c) {
+			float v = (float)s[c] * gain;
+			if (v > 32767.0f) {
+				v = 32767.0f;
+			}
+			else if (v < -32768.0f) {
+				v = -32768.0f;
+			}
+			s[c] = (short)(v >= 0.0f ? v + 0.5f : v - 0.5f);
+		}
+	}
+}
@@ -0,0 +1,54 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Per-client gain stage applied to the voice stream before TeamSpeak mixes it
+ */
+
+#ifndef DPAR_AUDIO_H
+#define DPAR_AUDIO_H
+
+#include <atomic>
+#include "teamspeak/public_definitions.h"
+
+#define DPAR_MAX_CLIENTS 65536
+
+// Frames whose peak sample is at or below this (about -72dBFS) are treated as silence
+#define DPAR_SILENCE_PEAK 8
+
+// Gains below this are treated as muted
+#define DPAR_SILENCE_GAIN 0.0001f
+
+/*
+ * Holds the gain the rolloff callback asked for (target) and the gain that was
+ * last applied to the client's audio (current). Targets are written from the
+ * rolloff callback, current values are only touched by the playback thread.
+ */
+class ClientGainTable {
+	std::atomic<float> targets[DPAR_MAX_CLIENTS];
+	float current[DPAR_MAX_CLIENTS];
+	bool silent[DPAR_MAX_CLIENTS];
+
+	public:
+		ClientGainTable();
+
+		void setTarget(anyID clientID, float gain);
+		float target(anyID clientID) const;
+
+		// Moves every client back to unity gain, used when positional audio stops applying
+		void reset();
+
+		// Applies the gain for one frame of the client's audio, ramping from the previously applied gain to the target.
+		// Returns false without doing any DSP when the frame is silent or the client is at zero gain.
+		bool process(anyID clientID, short* samples, int sampleCount, int channels);
+
+		// Whether the last frame passed through process() was silent, lets later hooks skip the client
+		bool wasSilent(anyID clientID) const;
+};
+
+// Largest absolute sample value in the buffer
+int dpar_peakAbs(const short* samples, int count);
+
+// Multiplies interleaved samples by a gain ramping linearly from `from` to `to` over the frame, saturating to int16
+void dpar_applyGainRamp(short* samples, int sampleCount, int channels, float from, float to);
+
+#endif
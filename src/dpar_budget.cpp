@@ -0,0 +1,90 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <algorithm>
+#include <set>
+#include "dpar_budget.hpp"
+
+TalkerBudget::TalkerBudget() {
+	for (int i = 0; i < DPAR_MAX_CLIENTS; ++i) {
+		talking[i].store(false, std::memory_order_relaxed);
+		benched[i].store(false, std::memory_order_relaxed);
+	}
+}
+
+void TalkerBudget::setTalking(anyID clientID, bool isTalking) {
+	talking[clientID].store(isTalking, std::memory_order_relaxed);
+}
+
+bool TalkerBudget::isBenched(anyID clientID) const {
+	return benched[clientID].load(std::memory_order_relaxed);
+}
+
+void TalkerBudget::select(const std::pmr::vector<std::pair<anyID, float>>& distances, int limit, bool mutesBenched, std::chrono::steady_clock::time_point now) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Scratch comes from wherever the caller's distances live, the tick arena when applying positions
+	std::pmr::memory_resource* scratch = distances.get_allocator().resource();
+
+	// A muted talker shows as silent whether they are or not, so a benched one keeps their place until the budget
+	// has room for them. Otherwise a benched talker still counts as one within its hold
+	std::pmr::vector<std::pair<float, anyID>> talkers(scratch);
+	for (size_t i = 0; i < distances.size(); ++i) {
+		const anyID clientID = distances[i].first;
+		std::map<anyID, std::chrono::steady_clock::time_point>::const_iterator held = benchedUntil.find(clientID);
+		const bool isBenched = held != benchedUntil.end();
+		if (talking[clientID].load(std::memory_order_relaxed) || (isBenched && (mutesBenched || now < held->second))) {
+			talkers.push_back(std::make_pair(distances[i].second, clientID));
+		}
+	}
+	std::sort(talkers.begin(), talkers.end());
+
+	std::pmr::set<anyID> stillBenched(scratch);
+	for (size_t rank = 0; rank < talkers.size(); ++rank) {
+		const anyID clientID = talkers[rank].second;
+		if (limit <= 0 || rank < (size_t)limit) {
+			continue;
+		}
+
+		std::map<anyID, std::chrono::steady_clock::time_point>::iterator held = benchedUntil.find(clientID);
+		if (held == benchedUntil.end()) {
+			benchedUntil[clientID] = now + std::chrono::milliseconds(DPAR_BUDGET_HOLD_MS);
+		}
+		else if (talking[clientID].load(std::memory_order_relaxed)) {
+			held->second = now + std::chrono::milliseconds(DPAR_BUDGET_HOLD_MS);
+		}
+		benched[clientID].store(true, std::memory_order_relaxed);
+		stillBenched.insert(clientID);
+	}
+
+	// In budget again, stopped talking past their hold (only seen while unmuted), or no longer placed
+	for (std::map<anyID, std::chrono::steady_clock::time_point>::iterator it = benchedUntil.begin(); it != benchedUntil.end();) {
+		if (stillBenched.count(it->first)) {
+			++it;
+			continue;
+		}
+		benched[it->first].store(false, std::memory_order_relaxed);
+		it = benchedUntil.erase(it);
+	}
+}
+
+void TalkerBudget::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (std::map<anyID, std::chrono::steady_clock::time_point>::const_iterator it = benchedUntil.begin(); it != benchedUntil.end(); ++it) {
+		benched[it->first].store(false, std::memory_order_relaxed);
+	}
+	benchedUntil.clear();
+}
+
+void TalkerBudget::clear() {
+	reset();
+	for (int i = 0; i < DPAR_MAX_CLIENTS; ++i) {
+		talking[i].store(false, std::memory_order_relaxed);
+	}
+}
+
+size_t TalkerBudget::benchedCount() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return benchedUntil.size();
+}
@@ -0,0 +1,54 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Voice budget. With more people talking at once than the budget allows, only the nearest
+ * talkers are kept, the rest are faded out (and muted when auto-mute is on) so decoding
+ * and mixing cost stays bounded however many people talk
+ */
+
+#ifndef DPAR_BUDGET_H
+#define DPAR_BUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+#include "dpar_audio.hpp"
+
+// Shortest time a talker stays benched, so one who keeps talking isn't let in and out on every tick
+#define DPAR_BUDGET_HOLD_MS 2000
+
+class TalkerBudget {
+	std::atomic<bool> talking[DPAR_MAX_CLIENTS];   // From talk status events
+	std::atomic<bool> benched[DPAR_MAX_CLIENTS];   // Faded out, read from the rolloff callback
+
+	std::mutex mutex;
+	std::map<anyID, std::chrono::steady_clock::time_point> benchedUntil;
+
+	public:
+		TalkerBudget();
+
+		void setTalking(anyID clientID, bool isTalking);
+		bool isBenched(anyID clientID) const;
+
+		// Works out which talkers fit a budget of limit (0 for no limit), nearest first, from the distance of every
+		// client placed this tick. Clients that aren't placed are never benched. mutesBenched is whether benched talkers
+		// get muted, which stops their talk status events, so they stay benched until there's room rather than until
+		// they look silent
+		void select(const std::pmr::vector<std::pair<anyID, float>>& distances, int limit, bool mutesBenched, std::chrono::steady_clock::time_point now);
+
+		// Lets every benched talker back in
+		void reset();
+
+		// As reset, and forgets who is talking, for a new connection
+		void clear();
+
+		size_t benchedCount();
+};
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "dpar_cache.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Layout, native byte order since the file never leaves the machine that wrote it:
+ *   "DPAC" u32 version
+ *   u32 configs   { str uri, str validator, f32 offset, f32 cutoff, f32 attenuationCoefficient, u8 canHearUnregistered, u64 version }
+ *   u32 servers   { str uid, u32 channels { u64 channelID, u32 targets { str uri, i32 weight } } }
+ * where str is a u16 length followed by that many bytes
+ */
+static const char CacheMagic[4] = { 'D', 'P', 'A', 'C' };
+
+/* Read only view of a whole file, unmapped when it goes out of scope */
+class MappedFile {
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+
+	public:
+		explicit MappedFile(const std::string& path) : data(NULL), size(0) {
+#ifdef _WIN32
+			mapping = NULL;
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (file == INVALID_HANDLE_VALUE) {
+				return;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+				return;
+			}
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping == NULL) {
+				return;
+			}
+			data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data != NULL) {
+				size = (size_t)fileSize.QuadPart;
+			}
+#else
+			fd = open(path.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return;
+			}
+			struct stat info;
+			if (fstat(fd, &info) != 0 || info.st_size == 0) {
+				return;
+			}
+			void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view != MAP_FAILED) {
+				data = (const unsigned char*)view;
+				size = (size_t)info.st_size;
+			}
+#endif
+		}
+
+		~MappedFile() {
+#ifdef _WIN32
+			if (data != NULL) {
+				UnmapViewOfFile(data);
+			}
+			if (mapping != NULL) {
+				CloseHandle(mapping);
+			}
+			if (file != INVALID_HANDLE_VALUE) {
+				CloseHandle(file);
+			}
+#else
+			if (data != NULL) {
+				munmap((void*)data, size);
+			}
+			if (fd >= 0) {
+				close(fd);
+			}
+#endif
+		}
+
+		const unsigned char* bytes() const { return data; }
+		size_t length() const { return size; }
+};
+
+/* Bounds checked reads, the first overrun fails every read after it */
+class CacheReader {
+	const unsigned char* pos;
+	const unsigned char* end;
+	bool ok;
+
+	public:
+		CacheReader(const unsigned char* data, size_t size) : pos(data), end(data + size), ok(data != NULL) {}
+
+		bool good() const { return ok; }
+
+		template<typename T>
+		T read() {
+			T value = T();
+			if (!ok || (size_t)(end - pos) < sizeof(T)) {
+				ok = false;
+				return value;
+			}
+			memcpy(&value, pos, sizeof(T));
+			pos += sizeof(T);
+			return value;
+		}
+
+		std::string readString() {
+			const uint16_t length = read<uint16_t>();
+			if (!ok || (size_t)(end - pos) < length) {
+				ok = false;
+				return std::string();
+			}
+			std::string value((const char*)pos, length);
+			pos += length;
+			return value;
+		}
+
+		bool readMagic() {
+			if (!ok || (size_t)(end - pos) < sizeof(CacheMagic) || memcmp(pos, CacheMagic, sizeof(CacheMagic)) != 0) {
+				ok = false;
+				return false;
+			}
+			pos += sizeof(CacheMagic);
+			return true;
+		}
+};
+
+template<typename T>
+static void dpar_cacheWrite(std::string& out, T value) {
+	out.append((const char*)&value, sizeof(T));
+}
+
+static void dpar_cacheWriteString(std::string& out, const std::string& value) {
+	// Nothing stored comes close, anything longer is cut rather than corrupting the layout
+	const uint16_t length = (uint16_t)(value.size() > 0xFFFF ? 0xFFFF : value.size());
+	dpar_cacheWrite(out, length);
+	out.append(value.data(), length);
+}
+
+ConfigCache::ConfigCache() : changes(0), savedChanges(0) {
+}
+
+bool ConfigCache::load(const std::string& cachePath) {
+	std::lock_guard<std::mutex> lock(mutex);
+	path = cachePath;
+	configs.clear();
+	channels.clear();
+	savedChanges = changes;
+
+	MappedFile file(path);
+	CacheReader reader(file.bytes(), file.length());
+	if (!reader.readMagic() || reader.read<uint32_t>() != DPAR_CACHE_VERSION) {
+		return false;
+	}
+
+	std::map<std::string, CachedConfig> readConfigs;
+	const uint32_t configCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < configCount && reader.good(); ++i) {
+		const std::string uri = reader.readString();
+		CachedConfig& cached = readConfigs[uri];
+		cached.validator = reader.readString();
+		cached.config.offset = reader.read<float>();
+		cached.config.cutoff = reader.read<float>();
+		cached.config.attenuationCoefficient = reader.read<float>();
+		cached.config.canHearUnregistered = reader.read<uint8_t>() != 0;
+		cached.config.version = reader.read<uint64_t>();
+	}
+
+	std::map<std::string, std::map<uint64, ChannelEndpoint>> readChannels;
+	const uint32_t serverCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < serverCount && reader.good(); ++i) {
+		std::map<uint64, ChannelEndpoint>& index = readChannels[reader.readString()];
+		const uint32_t channelCount = reader.read<uint32_t>();
+		for (uint32_t c = 0; c < channelCount && reader.good(); ++c) {
+			const uint64 channelID = reader.read<uint64>();
+			ChannelEndpoint& channel = index[channelID];
+			const uint32_t targetCount = reader.read<uint32_t>();
+			for (uint32_t t = 0; t < targetCount && reader.good(); ++t) {
+				ReportingTarget target;
+				target.uri = reader.readString();
+				target.weight = reader.read<int32_t>();
+				channel.targets.push_back(target);
+			}
+		}
+	}
+
+	// A truncated or damaged file is dropped whole, it gets rewritten from what this run learns
+	if (!reader.good()) {
+		return false;
+	}
+
+	configs.swap(readConfigs);
+	channels.swap(readChannels);
+	return true;
+}
+
+bool ConfigCache::save() {
+	std::lock_guard<std::mutex> serialized(writing);
+
+	std::string out;
+	std::string target;
+	uint64_t saving;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (changes == savedChanges || path.empty()) {
+			return true;
+		}
+		target = path;
+		saving = changes;
+
+		out.append(CacheMagic, sizeof(CacheMagic));
+		dpar_cacheWrite<uint32_t>(out, DPAR_CACHE_VERSION);
+
+		dpar_cacheWrite<uint32_t>(out, (uint32_t)configs.size());
+		for (std::map<std::string, CachedConfig>::const_iterator it = configs.begin(); it != configs.end(); ++it) {
+			dpar_cacheWriteString(out, it->first);
+			dpar_cacheWriteString(out, it->second.validator);
+			dpar_cacheWrite<float>(out, it->second.config.offset);
+			dpar_cacheWrite<float>(out, it->second.config.cutoff);
+			dpar_cacheWrite<float>(out, it->second.config.attenuationCoefficient);
+			dpar_cacheWrite<uint8_t>(out, it->second.config.canHearUnregistered ? 1 : 0);
+			dpar_cacheWrite<uint64_t>(out, it->second.config.version);
+		}
+
+		dpar_cacheWrite<uint32_t>(out, (uint32_t)channels.size());
+		for (std::map<std::string, std::map<uint64, ChannelEndpoint>>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+			dpar_cacheWriteString(out, it->first);
+			dpar_cacheWrite<uint32_t>(out, (uint32_t)it->second.size());
+			for (std::map<uint64, ChannelEndpoint>::const_iterator c = it->second.begin(); c != it->second.end(); ++c) {
+				dpar_cacheWrite<uint64>(out, c->first);
+				dpar_cacheWrite<uint32_t>(out, (uint32_t)c->second.targets.size());
+				for (size_t t = 0; t < c->second.targets.size(); ++t) {
+					dpar_cacheWriteString(out, c->second.targets[t].uri);
+					dpar_cacheWrite<int32_t>(out, c->second.targets[t].weight);
+				}
+			}
+		}
+	}
+
+	// Written beside the old file and swapped in, a crash mid write leaves the previous cache intact
+	const std::string temporary = target + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+	const bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+	if (fclose(file) != 0 || !written) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+#ifdef _WIN32
+	const bool replaced = MoveFileExA(temporary.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	const bool replaced = rename(temporary.c_str(), target.c_str()) == 0;
+#endif
+	if (!replaced) {
+		// Still differs from what's on disk, so the next save tries again
+		remove(temporary.c_str());
+		return false;
+	}
+
+	// Changes made while this was being written are newer than the file and still need saving
+	std::lock_guard<std::mutex> lock(mutex);
+	savedChanges = saving;
+	return true;
+}
+
+void ConfigCache::storeConfig(const std::string& uri, const RemoteConfig& config, const std::string& validator) {
+	std::lock_guard<std::mutex> lock(mutex);
+	CachedConfig& cached = configs[uri];
+	cached.config = config;
+	cached.validator = validator;
+	++changes;
+}
+
+std::map<std::string, CachedConfig> ConfigCache::allConfigs() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return configs;
+}
+
+void ConfigCache::storeChannels(const std::string& serverUID, const std::map<uint64, ChannelEndpoint>& index) {
+	if (serverUID.empty()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	channels[serverUID] = index;
+	++changes;
+}
+
+bool ConfigCache::loadChannels(const std::string& serverUID, std::map<uint64, ChannelEndpoint>& index) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<std::string, std::map<uint64, ChannelEndpoint>>::const_iterator it = channels.find(serverUID);
+	if (it == channels.end()) {
+		return false;
+	}
+	index = it->second;
+	return true;
+}
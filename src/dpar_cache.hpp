@@ -0,0 +1,59 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Cache file in the client's config directory holding the last config each reporting server
+ * sent and each server's channel index, so a restart or reconnect starts warm and revalidates
+ * in the background instead of waiting on the network before the first positional update
+ */
+
+#ifndef DPAR_CACHE_H
+#define DPAR_CACHE_H
+
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include "dpar_endpoint.hpp"
+#include "dpar_session.hpp"
+
+// Bumped whenever the layout changes, a file written with any other version is ignored
+#define DPAR_CACHE_VERSION 3
+
+#define DPAR_CACHE_FILE "dpar_cache.bin"
+
+/* Config as a reporting server last sent it, with the ETag to revalidate it against */
+struct CachedConfig {
+	RemoteConfig config;
+	std::string validator;
+};
+
+class ConfigCache {
+	std::mutex mutex;
+	std::string path;
+	std::map<std::string, CachedConfig> configs;                        // By endpoint uri
+	std::map<std::string, std::map<uint64, ChannelEndpoint>> channels;  // By server unique identifier
+
+	// Bumped by every change, the cache needs writing while the two differ
+	uint64_t changes;
+	uint64_t savedChanges;
+
+	// Held for the whole of a save so two of them never write the temporary file at once
+	std::mutex writing;
+
+	public:
+		ConfigCache();
+
+		// Maps the file and reads it, false (leaving the cache empty) if it's missing, damaged or another version
+		bool load(const std::string& path);
+
+		// Writes the cache back if anything changed since it was loaded or last saved
+		bool save();
+
+		void storeConfig(const std::string& uri, const RemoteConfig& config, const std::string& validator);
+		std::map<std::string, CachedConfig> allConfigs();
+
+		void storeChannels(const std::string& serverUID, const std::map<uint64, ChannelEndpoint>& index);
+		bool loadChannels(const std::string& serverUID, std::map<uint64, ChannelEndpoint>& index);
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <stdio.h>
+#include "dpar_clientlib.hpp"
+
+static unsigned int (*ClientlibFreeMemory)(void*) = NULL;
+
+// Sites push themselves on as they're first reached and are never removed
+static std::atomic<ClientlibSite*> Sites(NULL);
+
+ClientlibSite::ClientlibSite(const char* name) : name(name), outstanding(0), taken(0) {
+	next = Sites.load();
+	while (!Sites.compare_exchange_weak(next, this)) {
+	}
+}
+
+void dpar_clientlibInit(unsigned int (*freeMemory)(void*)) {
+	ClientlibFreeMemory = freeMemory;
+}
+
+void dpar_clientlibFree(void* pointer, ClientlibSite* site) {
+	if (ClientlibFreeMemory != NULL) {
+		ClientlibFreeMemory(pointer);
+	}
+	if (site != NULL) {
+		site->outstanding--;
+	}
+}
+
+void dpar_clientlibTaken(ClientlibSite* site) {
+	if (site != NULL) {
+		site->outstanding++;
+		site->taken++;
+	}
+}
+
+std::string dpar_clientlibSummary() {
+	std::string summary;
+	for (ClientlibSite* site = Sites.load(); site != NULL; site = site->next) {
+		char line[160];
+		snprintf(line, sizeof(line), "%s: %lld held, %llu taken\n", site->name, (long long)site->outstanding.load(), (unsigned long long)site->taken.load());
+		summary += line;
+	}
+	return summary;
+}
@@ -0,0 +1,97 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Ownership of the strings and arrays the client library hands out, which must go back through
+ * its freeMemory. Builds with DPAR_TRACK_CLIENTLIB (any build without NDEBUG, or a release build
+ * with msbuild /p:DparTrackClientlib=true) also count what each call site is holding so a slow
+ * leak shows up in the info panel rather than in Task Manager
+ */
+
+#ifndef DPAR_CLIENTLIB_H
+#define DPAR_CLIENTLIB_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#if !defined(NDEBUG) && !defined(DPAR_TRACK_CLIENTLIB)
+#define DPAR_TRACK_CLIENTLIB
+#endif
+
+/* One place clientlib memory is taken, registered the first time it's reached */
+struct ClientlibSite {
+	const char* name;
+	std::atomic<int64_t> outstanding;
+	std::atomic<uint64_t> taken;
+	ClientlibSite* next;
+
+	explicit ClientlibSite(const char* name);
+};
+
+#ifdef DPAR_TRACK_CLIENTLIB
+#define DPAR_CLIENTLIB_SITE(name) ([]() -> ClientlibSite* { static ClientlibSite site(name); return &site; }())
+#else
+#define DPAR_CLIENTLIB_SITE(name) ((ClientlibSite*)NULL)
+#endif
+
+// The client library's freeMemory, set once the plugin is handed its function pointers
+void dpar_clientlibInit(unsigned int (*freeMemory)(void*));
+
+void dpar_clientlibFree(void* pointer, ClientlibSite* site);
+void dpar_clientlibTaken(ClientlibSite* site);
+
+// Per site counts, one line each, empty unless tracking is built in
+std::string dpar_clientlibSummary();
+
+/* Owns one clientlib buffer, pass out() where the call wants somewhere to put it */
+template<typename T>
+class ClientlibPtr {
+	T* pointer;
+	ClientlibSite* site;
+	bool counted;
+
+	// The call filled pointer in behind our back, count it the first time it's seen
+	void notice() {
+		if (pointer != NULL && !counted) {
+			dpar_clientlibTaken(site);
+			counted = true;
+		}
+	}
+
+	public:
+		explicit ClientlibPtr(ClientlibSite* site) : pointer(NULL), site(site), counted(false) {}
+		~ClientlibPtr() { reset(); }
+
+		ClientlibPtr(const ClientlibPtr&) = delete;
+		ClientlibPtr& operator=(const ClientlibPtr&) = delete;
+
+		// Frees anything already held
+		T** out() {
+			reset();
+			return &pointer;
+		}
+
+		T* get() {
+			notice();
+			return pointer;
+		}
+
+		T& operator[](size_t i) {
+			notice();
+			return pointer[i];
+		}
+
+		void reset() {
+			if (pointer != NULL) {
+				notice();
+				dpar_clientlibFree(pointer, site);
+				pointer = NULL;
+				counted = false;
+			}
+		}
+};
+
+typedef ClientlibPtr<char> ClientlibString;
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <algorithm>
+#include <stdint.h>
+#include "dpar_endpoint.hpp"
+
+CircuitBreaker::CircuitBreaker() : state(DPAR_BREAKER_CLOSED), failures(0), backoffMs(DPAR_BREAKER_BASE_MS), random(std::random_device()()) {
+}
+
+void CircuitBreaker::scheduleProbe() {
+	// Equal jitter: at least half the backoff, so clients that lost the server together don't probe together
+	std::uniform_int_distribution<int> jitter(0, backoffMs / 2);
+	nextProbe = std::chrono::steady_clock::now() + std::chrono::milliseconds(backoffMs / 2 + jitter(random));
+}
+
+bool CircuitBreaker::allowRequest() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (state == DPAR_BREAKER_CLOSED) {
+		return true;
+	}
+
+	if (std::chrono::steady_clock::now() < nextProbe) {
+		return false;
+	}
+
+	// Also covers a probe that never reported back, it gets one backoff period before another is sent
+	state = DPAR_BREAKER_HALF_OPEN;
+	scheduleProbe();
+	return true;
+}
+
+bool CircuitBreaker::recordSuccess() {
+	std::lock_guard<std::mutex> lock(mutex);
+	const bool wasOpen = state != DPAR_BREAKER_CLOSED;
+	state = DPAR_BREAKER_CLOSED;
+	failures = 0;
+	backoffMs = DPAR_BREAKER_BASE_MS;
+	return wasOpen;
+}
+
+bool CircuitBreaker::recordFailure() {
+	std::lock_guard<std::mutex> lock(mutex);
+	switch (state) {
+		case DPAR_BREAKER_CLOSED:
+			if (++failures < DPAR_BREAKER_FAILURES) {
+				return false;
+			}
+			state = DPAR_BREAKER_OPEN;
+			backoffMs = DPAR_BREAKER_BASE_MS;
+			scheduleProbe();
+			return true;
+		case DPAR_BREAKER_HALF_OPEN:
+			// Probe failed, wait twice as long before the next one
+			backoffMs = backoffMs * 2 > DPAR_BREAKER_MAX_MS ? DPAR_BREAKER_MAX_MS : backoffMs * 2;
+			state = DPAR_BREAKER_OPEN;
+			scheduleProbe();
+			return false;
+		default:
+			// A request that was already in flight when the breaker opened
+			return false;
+	}
+}
+
+DparBreakerState CircuitBreaker::currentState() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return state;
+}
+
+static web::http::client::http_client_config dpar_deadlineConfig(std::chrono::milliseconds deadline) {
+	// cpprest applies this to connecting, sending and receiving alike
+	web::http::client::http_client_config config;
+	config.set_timeout(deadline);
+	return config;
+}
+
+ReportingEndpoint::ReportingEndpoint(const std::string& uri, std::chrono::milliseconds tickDeadline)
+	: uri(uri), client(utility::conversions::to_string_t(uri)), tickClient(utility::conversions::to_string_t(uri), dpar_deadlineConfig(tickDeadline)), prefetching(false), rttMicros(0), hasConfig(false), configFresh(false) {
+}
+
+void ReportingEndpoint::recordRoundTrip(std::chrono::steady_clock::duration elapsed) {
+	const int64_t sample = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+	const int64_t smoothed = rttMicros.load(std::memory_order_relaxed);
+
+	// Exponential moving average weighting the newest sample by 1/8, the same smoothing TCP uses for its RTT
+	rttMicros.store(smoothed == 0 ? sample : smoothed + (sample - smoothed) / 8, std::memory_order_relaxed);
+}
+
+void ReportingEndpoint::storeConfig(const RemoteConfig& config, const std::string& validator) {
+	std::lock_guard<std::mutex> lock(configMutex);
+	lastConfig = config;
+	lastValidator = validator;
+	hasConfig = true;
+	configFresh = true;
+}
+
+void ReportingEndpoint::seedConfig(const RemoteConfig& config, const std::string& validator) {
+	std::lock_guard<std::mutex> lock(configMutex);
+	if (hasConfig) {
+		return;
+	}
+	lastConfig = config;
+	lastValidator = validator;
+	hasConfig = true;
+	configFresh = false;
+}
+
+bool ReportingEndpoint::isConfigFresh() {
+	std::lock_guard<std::mutex> lock(configMutex);
+	return configFresh;
+}
+
+std::string ReportingEndpoint::configValidator() {
+	std::lock_guard<std::mutex> lock(configMutex);
+	return hasConfig ? lastValidator : std::string();
+}
+
+bool ReportingEndpoint::loadConfig(RemoteConfig& config) {
+	std::lock_guard<std::mutex> lock(configMutex);
+	if (!hasConfig) {
+		return false;
+	}
+	config = lastConfig;
+	return true;
+}
+
+EndpointRegistry::EndpointRegistry(std::chrono::milliseconds tickDeadline) : tickDeadline(tickDeadline), random(std::random_device()()) {
+}
+
+std::shared_ptr<ReportingEndpoint> EndpointRegistry::get(const std::string& uri) {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<std::string, std::shared_ptr<ReportingEndpoint>>::iterator it = endpoints.find(uri);
+	if (it != endpoints.end()) {
+		return it->second;
+	}
+
+	std::shared_ptr<ReportingEndpoint> endpoint = std::make_shared<ReportingEndpoint>(uri, tickDeadline);
+	endpoints[uri] = endpoint;
+	return endpoint;
+}
+
+std::shared_ptr<ReportingEndpoint> EndpointRegistry::route(const std::vector<ReportingTarget>& targets, const std::set<std::string>& exclude) {
+	struct Candidate {
+		std::shared_ptr<ReportingEndpoint> endpoint;
+		int weight;
+		int64_t rtt;
+	};
+
+	std::vector<Candidate> healthy;
+	std::vector<Candidate> recovering;
+	int64_t fastest = INT64_MAX;
+
+	for (size_t i = 0; i < targets.size(); ++i) {
+		if (exclude.count(targets[i].uri)) {
+			continue;
+		}
+
+		Candidate candidate;
+		try {
+			candidate.endpoint = get(targets[i].uri);
+		}
+		catch (const std::exception&) {
+			continue;
+		}
+		candidate.weight = std::max(1, targets[i].weight);
+		candidate.rtt = candidate.endpoint->rttMicros.load(std::memory_order_relaxed);
+
+		if (candidate.endpoint->breaker.currentState() == DPAR_BREAKER_CLOSED) {
+			if (candidate.rtt > 0 && candidate.rtt < fastest) {
+				fastest = candidate.rtt;
+			}
+			healthy.push_back(candidate);
+		}
+		else {
+			recovering.push_back(candidate);
+		}
+	}
+
+	if (healthy.empty()) {
+		std::sort(recovering.begin(), recovering.end(), [](const Candidate& a, const Candidate& b) { return a.rtt < b.rtt; });
+		for (size_t i = 0; i < recovering.size(); ++i) {
+			if (recovering[i].endpoint->breaker.allowRequest()) {
+				return recovering[i].endpoint;
+			}
+		}
+		return std::shared_ptr<ReportingEndpoint>();
+	}
+
+	// Unmeasured servers stay in the draw so they get measured
+	const int64_t limit = fastest == INT64_MAX ? INT64_MAX : fastest + fastest / 4 + DPAR_ROUTE_RTT_SLACK_US;
+	int totalWeight = 0;
+	for (size_t i = 0; i < healthy.size(); ++i) {
+		if (healthy[i].rtt <= limit) {
+			totalWeight += healthy[i].weight;
+		}
+	}
+
+	int draw;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		draw = std::uniform_int_distribution<int>(0, totalWeight - 1)(random);
+	}
+	for (size_t i = 0; i < healthy.size(); ++i) {
+		if (healthy[i].rtt > limit) {
+			continue;
+		}
+		if (draw < healthy[i].weight) {
+			return healthy[i].endpoint;
+		}
+		draw -= healthy[i].weight;
+	}
+	return healthy[0].endpoint;
+}
+
+bool EndpointRegistry::anyHealthy(const std::vector<ReportingTarget>& targets) {
+	for (size_t i = 0; i < targets.size(); ++i) {
+		try {
+			if (get(targets[i].uri)->breaker.currentState() == DPAR_BREAKER_CLOSED) {
+				return true;
+			}
+		}
+		catch (const std::exception&) {
+			continue;
+		}
+	}
+	return false;
+}
+
+void EndpointRegistry::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	endpoints.clear();
+}
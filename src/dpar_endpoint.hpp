@@ -0,0 +1,136 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Reporting server endpoints. Each keeps one http_client for its lifetime and a circuit
+ * breaker that stops requests while the server is unreachable, probing it again with
+ * exponential backoff until it answers. A channel may name several servers, requests go
+ * to the fastest healthy one.
+ */
+
+#ifndef DPAR_ENDPOINT_H
+#define DPAR_ENDPOINT_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "cpprest/http_client.h"
+
+// Consecutive failures before the breaker opens
+#define DPAR_BREAKER_FAILURES 3
+// First and longest wait between probes of an open breaker
+#define DPAR_BREAKER_BASE_MS 500
+#define DPAR_BREAKER_MAX_MS 30000
+
+// Servers this close to the fastest (a quarter of its RTT plus the slack) share the load by weight
+#define DPAR_ROUTE_RTT_SLACK_US 2000
+
+enum DparBreakerState {
+	DPAR_BREAKER_CLOSED = 0,
+	DPAR_BREAKER_OPEN,
+	DPAR_BREAKER_HALF_OPEN
+};
+
+class CircuitBreaker {
+	std::mutex mutex;
+	DparBreakerState state;
+	int failures;
+	int backoffMs;
+	std::chrono::steady_clock::time_point nextProbe;
+	std::mt19937 random;
+
+	void scheduleProbe();
+
+	public:
+		CircuitBreaker();
+
+		// True while closed, once open only a single probe is let through each time the backoff passes
+		bool allowRequest();
+
+		// Each returns true when the call changed the state, so the caller can act once per outage
+		bool recordSuccess();
+		bool recordFailure();
+
+		DparBreakerState currentState();
+};
+
+/* Attenuation config served by a reporting server's /config */
+struct RemoteConfig {
+	float offset;
+	float cutoff;
+	float attenuationCoefficient;
+	bool canHearUnregistered;
+	uint64_t version;  // 0 if the server doesn't number its configs
+};
+
+/* One reporting server a channel names, weight is its share of the load among servers about as fast */
+struct ReportingTarget {
+	std::string uri;
+	int weight;
+};
+
+struct ReportingEndpoint {
+	std::string uri;
+	web::http::client::http_client client;      // Config and other one off requests, cpprest's default timeouts
+	web::http::client::http_client tickClient;  // Position requests, which give up at the request deadline
+	CircuitBreaker breaker;
+
+	// Set while a background /config fetch is out so channels sharing the server only fetch it once
+	std::atomic<bool> prefetching;
+
+	// Smoothed round trip of successful requests, 0 until the first one
+	std::atomic<int64_t> rttMicros;
+
+	ReportingEndpoint(const std::string& uri, std::chrono::milliseconds tickDeadline);
+
+	void recordRoundTrip(std::chrono::steady_clock::duration elapsed);
+
+	// Last config fetched from this server, lets a channel using it start without another round trip
+	void storeConfig(const RemoteConfig& config, const std::string& validator);
+	bool loadConfig(RemoteConfig& config);
+
+	// As storeConfig for a config remembered from an earlier run, usable straight away but not fresh until revalidated
+	void seedConfig(const RemoteConfig& config, const std::string& validator);
+	bool isConfigFresh();
+
+	// ETag the stored config came with, empty if there is none to revalidate against
+	std::string configValidator();
+
+	private:
+		std::mutex configMutex;
+		RemoteConfig lastConfig;
+		std::string lastValidator;
+		bool hasConfig;
+		bool configFresh;
+};
+
+/* Endpoints by uri, created on first use and shared by everything talking to that server */
+class EndpointRegistry {
+	std::mutex mutex;
+	std::map<std::string, std::shared_ptr<ReportingEndpoint>> endpoints;
+	std::chrono::milliseconds tickDeadline;
+	std::mt19937 random;
+
+	public:
+		explicit EndpointRegistry(std::chrono::milliseconds tickDeadline);
+
+		// Throws if the uri can't be parsed
+		std::shared_ptr<ReportingEndpoint> get(const std::string& uri);
+
+		// Picks the server a request should go to, the fastest healthy one of targets (skipping any in exclude), spreading
+		// load by weight among those about as fast. With none healthy it's the first whose breaker lets a probe through,
+		// NULL if none do
+		std::shared_ptr<ReportingEndpoint> route(const std::vector<ReportingTarget>& targets, const std::set<std::string>& exclude);
+
+		// True if any of targets has a closed breaker, unlike route this never uses up a probe
+		bool anyHealthy(const std::vector<ReportingTarget>& targets);
+
+		void clear();
+};
+
+#endif
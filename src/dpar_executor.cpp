@@ -0,0 +1,151 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <exception>
+#include "dpar_executor.hpp"
+
+IoExecutor::IoExecutor(size_t capacity) : capacity(capacity), stopping(false), running(0), outstanding(0) {
+}
+
+void IoExecutor::start(int workerCount) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!workers.empty()) {
+		return;
+	}
+
+	stopping = false;
+	for (int i = 0; i < workerCount; ++i) {
+		workers.push_back(std::thread(&IoExecutor::run, this));
+	}
+}
+
+bool IoExecutor::isIdle() {
+	return queue.empty() && running == 0 && outstanding == 0;
+}
+
+bool IoExecutor::drain(std::chrono::milliseconds bound) {
+	std::unique_lock<std::mutex> lock(mutex);
+	return idle.wait_for(lock, bound, [this]() { return isIdle(); });
+}
+
+void IoExecutor::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		queue.clear();
+		queuedKeys.clear();
+	}
+	wake.notify_all();
+
+	for (size_t i = 0; i < workers.size(); ++i) {
+		if (workers[i].joinable()) {
+			workers[i].join();
+		}
+	}
+	workers.clear();
+}
+
+bool IoExecutor::post(std::function<void()> work) {
+	return postUnique(0, std::move(work));
+}
+
+bool IoExecutor::postUnique(uint64 key, std::function<void()> work) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopping || queue.size() >= capacity) {
+			return false;
+		}
+
+		if (key != 0) {
+			if (queuedKeys.count(key)) {
+				return true;
+			}
+			queuedKeys.insert(key);
+		}
+
+		Task task;
+		task.key = key;
+		task.work = std::move(work);
+		queue.push_back(std::move(task));
+	}
+	wake.notify_one();
+	return true;
+}
+
+bool IoExecutor::isStopping() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stopping;
+}
+
+size_t IoExecutor::pending() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return queue.size();
+}
+
+void IoExecutor::beginAsync() {
+	std::lock_guard<std::mutex> lock(mutex);
+	++outstanding;
+}
+
+void IoExecutor::endAsync() {
+	bool nowIdle;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		--outstanding;
+		nowIdle = isIdle();
+	}
+	if (nowIdle) {
+		idle.notify_all();
+	}
+}
+
+void IoExecutor::run() {
+	for (;;) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (stopping) {
+				return;
+			}
+
+			task = std::move(queue.front());
+			queue.pop_front();
+			if (task.key != 0) {
+				// Once running, the same work may be queued again for the next round
+				queuedKeys.erase(task.key);
+			}
+			++running;
+		}
+
+		try {
+			task.work();
+		}
+		catch (const std::exception&) {
+			// Work reports its own failures, an escaped exception must not take the worker down
+		}
+
+		bool nowIdle;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--running;
+			nowIdle = isIdle();
+		}
+		if (nowIdle) {
+			idle.notify_all();
+		}
+	}
+}
+
+void IoScheduler::schedule(pplx::TaskProc_t proc, void* param) {
+	if (executor.post([proc, param]() { proc(param); })) {
+		return;
+	}
+
+	// pplx expects every chore it schedules to run, so when the queue is full run it on the caller instead.
+	// Once stopped the plugin may be unloading, a chore left unrun only leaks its task
+	if (!executor.isStopping()) {
+		proc(param);
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Small pool of worker threads draining a bounded queue, used for everything that talks
+ * to the reporting server so TeamSpeak's own threads never wait on the network
+ */
+
+#ifndef DPAR_EXECUTOR_H
+#define DPAR_EXECUTOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "pplx/pplxtasks.h"
+#include "teamspeak/public_definitions.h"
+
+class IoExecutor {
+	struct Task {
+		uint64 key;                   // 0 for tasks that are never coalesced
+		std::function<void()> work;
+	};
+
+	size_t capacity;
+	std::deque<Task> queue;
+	std::set<uint64> queuedKeys;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	bool stopping;
+	int running;
+	int outstanding;
+
+	bool isIdle();
+
+	void run();
+
+	public:
+		explicit IoExecutor(size_t capacity);
+
+		void start(int workerCount);
+
+		// Waits up to bound for queued, running and outstanding asynchronous work to finish, false if it didn't
+		bool drain(std::chrono::milliseconds bound);
+
+		// Wakes the workers, drops anything still queued and joins them
+		void stop();
+
+		bool isStopping();
+
+		// Queues work, returns false if the queue is full or the executor is stopping
+		bool post(std::function<void()> work);
+
+		// As post, but does nothing (and returns true) if work with the same key is already waiting to run
+		bool postUnique(uint64 key, std::function<void()> work);
+
+		size_t pending();
+
+		// Brackets work that is in flight outside the queue, such as a request waiting on the network
+		void beginAsync();
+		void endAsync();
+};
+
+/* Runs pplx continuations on an IoExecutor instead of the default thread pool */
+class IoScheduler : public pplx::scheduler_interface {
+	IoExecutor& executor;
+
+	public:
+		explicit IoScheduler(IoExecutor& executor) : executor(executor) {}
+
+		virtual void schedule(pplx::TaskProc_t proc, void* param);
+};
+
+#endif
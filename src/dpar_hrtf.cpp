@@ -0,0 +1,423 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include "dpar_hrtf.hpp"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DPAR_SSE2
+#include <emmintrin.h>
+#endif
+
+static const double Pi = 3.14159265358979323846;
+
+/********************************** FFT *********************************/
+
+Fft::Fft(int size) : n(size), cosTable(size / 2), sinTable(size / 2), bitReverse(size) {
+	for (int k = 0; k < n / 2; ++k) {
+		cosTable[k] = (float)cos(2.0 * Pi * k / n);
+		sinTable[k] = (float)sin(2.0 * Pi * k / n);
+	}
+
+	int bits = 0;
+	while ((1 << bits) < n) {
+		++bits;
+	}
+	for (int i = 0; i < n; ++i) {
+		int r = 0;
+		for (int b = 0; b < bits; ++b) {
+			if (i & (1 << b)) {
+				r |= 1 << (bits - 1 - b);
+			}
+		}
+		bitReverse[i] = r;
+	}
+}
+
+void Fft::transform(float* re, float* im, bool inverse) const {
+	for (int i = 0; i < n; ++i) {
+		int j = bitReverse[i];
+		if (i < j) {
+			float t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	const float direction = inverse ? 1.0f : -1.0f;
+
+	for (int len = 2; len <= n; len <<= 1) {
+		const int half = len >> 1;
+		const int stride = n / len;
+
+		for (int i = 0; i < n; i += len) {
+			for (int k = 0; k < half; ++k) {
+				const float wr = cosTable[k * stride];
+				const float wi = direction * sinTable[k * stride];
+				const int a = i + k;
+				const int b = a + half;
+
+				const float tr = re[b] * wr - im[b] * wi;
+				const float ti = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+/********************************** HRIR set *********************************/
+
+HrirSet::HrirSet() :
+	re(DPAR_HRTF_DIRECTIONS * DPAR_HRTF_PARTITIONS * DPAR_HRTF_FFT),
+	im(DPAR_HRTF_DIRECTIONS * DPAR_HRTF_PARTITIONS * DPAR_HRTF_FFT) {
+}
+
+const float* HrirSet::partitionRe(int direction, int partition) const {
+	return &re[(direction * DPAR_HRTF_PARTITIONS + partition) * DPAR_HRTF_FFT];
+}
+
+const float* HrirSet::partitionIm(int direction, int partition) const {
+	return &im[(direction * DPAR_HRTF_PARTITIONS + partition) * DPAR_HRTF_FFT];
+}
+
+// One ear of the Brown-Duda spherical head model, evaluated on the bins of an n point FFT
+static void dpar_sphericalHeadResponse(double sourceAzimuth, double earAzimuth, int n, float* outRe, float* outIm) {
+	const double headRadius = 0.0875;
+	const double speedOfSound = 343.0;
+	const double alphaMin = 0.1;
+	const double thetaMin = 150.0 / 180.0 * Pi;
+	const double baseDelay = 8.0;                             // Samples, keeps the fractional delay causal
+
+	// Angle between the source and the ear's axis
+	const double incidence = acos(cos(sourceAzimuth - earAzimuth));
+
+	const double alpha = (1.0 + alphaMin / 2.0) + (1.0 - alphaMin / 2.0) * cos(incidence / thetaMin * Pi);
+	const double w0 = speedOfSound / headRadius;
+
+	double delay = incidence < Pi / 2.0
+		? -headRadius / speedOfSound * cos(incidence)
+		: headRadius / speedOfSound * (incidence - Pi / 2.0);
+	delay = (delay + headRadius / speedOfSound) * DPAR_HRTF_SAMPLE_RATE + baseDelay;
+
+	// Pinna shadowing cuts high frequencies for sources behind the head, this is the main front/back cue
+	const double rear = 0.5 * (cos(sourceAzimuth) < 0.0 ? -cos(sourceAzimuth) : 0.0);
+	const double rearCutoff = 2.0 * Pi * 4500.0;
+
+	for (int k = 0; k <= n / 2; ++k) {
+		const double w = 2.0 * Pi * k * DPAR_HRTF_SAMPLE_RATE / n;
+
+		// Head shadow: (1 + j*alpha*w/2w0) / (1 + j*w/2w0)
+		const double nr = 1.0, ni = alpha * w / (2.0 * w0);
+		const double dr = 1.0, di = w / (2.0 * w0);
+		const double dd = dr * dr + di * di;
+		double hr = (nr * dr + ni * di) / dd;
+		double hi = (ni * dr - nr * di) / dd;
+
+		// Rear cut: (1 - rear) + rear / (1 + j*w/wc)
+		const double lr = 1.0 / (1.0 + (w / rearCutoff) * (w / rearCutoff));
+		const double li = -(w / rearCutoff) * lr;
+		const double br = (1.0 - rear) + rear * lr;
+		const double bi = rear * li;
+		const double tr = hr * br - hi * bi;
+		const double ti = hr * bi + hi * br;
+
+		// Interaural delay
+		const double phase = -2.0 * Pi * k * delay / n;
+		outRe[k] = (float)(tr * cos(phase) - ti * sin(phase));
+		outIm[k] = (float)(tr * sin(phase) + ti * cos(phase));
+	}
+
+	// Hermitian symmetry so the impulse response is real
+	outIm[0] = 0.0f;
+	outIm[n / 2] = 0.0f;
+	for (int k = 1; k < n / 2; ++k) {
+		outRe[n - k] = outRe[k];
+		outIm[n - k] = -outIm[k];
+	}
+}
+
+void HrirSet::generate(const Fft& fft) {
+	const int n = 2 * DPAR_HRTF_LENGTH;
+	const int fadeLength = DPAR_HRTF_LENGTH / 8;
+	Fft responseFft(n);
+
+	std::vector<float> leftRe(n), leftIm(n), rightRe(n), rightIm(n);
+	std::vector<float> partRe(DPAR_HRTF_FFT), partIm(DPAR_HRTF_FFT);
+
+	for (int d = 0; d < DPAR_HRTF_DIRECTIONS; ++d) {
+		const double azimuth = 2.0 * Pi * d / DPAR_HRTF_DIRECTIONS;
+
+		dpar_sphericalHeadResponse(azimuth, -Pi / 2.0, n, &leftRe[0], &leftIm[0]);
+		dpar_sphericalHeadResponse(azimuth, Pi / 2.0, n, &rightRe[0], &rightIm[0]);
+		responseFft.transform(&leftRe[0], &leftIm[0], true);
+		responseFft.transform(&rightRe[0], &rightIm[0], true);
+
+		// Truncate to the HRIR length with a half Hann fade on the tail
+		for (int i = 0; i < DPAR_HRTF_LENGTH; ++i) {
+			float gain = 1.0f / n;
+			if (i >= DPAR_HRTF_LENGTH - fadeLength) {
+				const double x = (double)(i - (DPAR_HRTF_LENGTH - fadeLength)) / fadeLength;
+				gain *= (float)(0.5 * (1.0 + cos(Pi * x)));
+			}
+			leftRe[i] *= gain;
+			rightRe[i] *= gain;
+		}
+
+		for (int p = 0; p < DPAR_HRTF_PARTITIONS; ++p) {
+			for (int i = 0; i < DPAR_HRTF_FFT; ++i) {
+				partRe[i] = i < DPAR_HRTF_BLOCK ? leftRe[p * DPAR_HRTF_BLOCK + i] : 0.0f;
+				partIm[i] = i < DPAR_HRTF_BLOCK ? rightRe[p * DPAR_HRTF_BLOCK + i] : 0.0f;
+			}
+			fft.transform(&partRe[0], &partIm[0], false);
+
+			// Fold the inverse FFT scaling into the filter
+			float* dstRe = &re[(d * DPAR_HRTF_PARTITIONS + p) * DPAR_HRTF_FFT];
+			float* dstIm = &im[(d * DPAR_HRTF_PARTITIONS + p) * DPAR_HRTF_FFT];
+			for (int i = 0; i < DPAR_HRTF_FFT; ++i) {
+				dstRe[i] = partRe[i] / DPAR_HRTF_FFT;
+				dstIm[i] = partIm[i] / DPAR_HRTF_FFT;
+			}
+		}
+	}
+}
+
+/********************************** Spatializer *********************************/
+
+static int dpar_directionForAzimuth(float azimuth) {
+	const double step = 2.0 * Pi / DPAR_HRTF_DIRECTIONS;
+	int d = (int)floor(azimuth / step + 0.5);
+	d %= DPAR_HRTF_DIRECTIONS;
+	if (d < 0) {
+		d += DPAR_HRTF_DIRECTIONS;
+	}
+	return d;
+}
+
+static short dpar_saturate(float v) {
+	if (v > 32767.0f) {
+		return 32767;
+	}
+	if (v < -32768.0f) {
+		return -32768;
+	}
+	return (short)(v >= 0.0f ? v + 0.5f : v - 0.5f);
+}
+
+Spatializer::Spatializer() : fft(DPAR_HRTF_FFT), frameCounter(0), measuredBlocks(0), measuredNanoseconds(0) {
+	memset(slotOf, 0xFF, sizeof(slotOf));
+	for (int i = 0; i < DPAR_MAX_CLIENTS; ++i) {
+		azimuths[i].store(0.0f, std::memory_order_relaxed);
+	}
+}
+
+void Spatializer::init(int maxFrameSamples) {
+	hrirs.generate(fft);
+	convolvers.assign(DPAR_HRTF_MAX_TALKERS, Convolver());
+	for (size_t i = 0; i < convolvers.size(); ++i) {
+		convolvers[i].active = false;
+	}
+	mono.assign(maxFrameSamples, 0.0f);
+}
+
+void Spatializer::setDirection(anyID clientID, float azimuth) {
+	azimuths[clientID].store(azimuth, std::memory_order_relaxed);
+}
+
+Spatializer::Convolver& Spatializer::convolverFor(anyID clientID) {
+	unsigned char slot = slotOf[clientID];
+	if (slot < convolvers.size() && convolvers[slot].active && convolvers[slot].clientID == clientID) {
+		convolvers[slot].lastUsed = frameCounter;
+		return convolvers[slot];
+	}
+
+	// Take a free convolver, or the one that has gone unused the longest
+	size_t chosen = 0;
+	for (size_t i = 0; i < convolvers.size(); ++i) {
+		if (!convolvers[i].active) {
+			chosen = i;
+			break;
+		}
+		if (convolvers[i].lastUsed < convolvers[chosen].lastUsed) {
+			chosen = i;
+		}
+	}
+
+	Convolver& conv = convolvers[chosen];
+	memset(&conv, 0, sizeof(Convolver));
+	conv.clientID = clientID;
+	conv.active = true;
+	conv.lastUsed = frameCounter;
+	conv.direction = dpar_directionForAzimuth(azimuths[clientID].load(std::memory_order_relaxed));
+	conv.previousDirection = conv.direction;
+	slotOf[clientID] = (unsigned char)chosen;
+
+	return conv;
+}
+
+void Spatializer::accumulate(const Convolver& conv, int direction, float* outRe, float* outIm) {
+	memset(outRe, 0, sizeof(float) * DPAR_HRTF_FFT);
+	memset(outIm, 0, sizeof(float) * DPAR_HRTF_FFT);
+
+	for (int p = 0; p < DPAR_HRTF_PARTITIONS; ++p) {
+		const int slot = (conv.fdlHead - p + DPAR_HRTF_PARTITIONS) % DPAR_HRTF_PARTITIONS;
+		const float* xr = conv.fdlRe[slot];
+		const float* xi = conv.fdlIm[slot];
+		const float* hr = hrirs.partitionRe(direction, p);
+		const float* hi = hrirs.partitionIm(direction, p);
+		int k = 0;
+
+#ifdef DPAR_SSE2
+		for (; k + 4 <= DPAR_HRTF_FFT; k += 4) {
+			const __m128 a = _mm_loadu_ps(xr + k);
+			const __m128 b = _mm_loadu_ps(xi + k);
+			const __m128 c = _mm_loadu_ps(hr + k);
+			const __m128 d = _mm_loadu_ps(hi + k);
+
+			// (a + ib)(c + id) = (ac - bd) + i(ad + bc)
+			const __m128 accRe = _mm_add_ps(_mm_loadu_ps(outRe + k), _mm_sub_ps(_mm_mul_ps(a, c), _mm_mul_ps(b, d)));
+			const __m128 accIm = _mm_add_ps(_mm_loadu_ps(outIm + k), _mm_add_ps(_mm_mul_ps(a, d), _mm_mul_ps(b, c)));
+			_mm_storeu_ps(outRe + k, accRe);
+			_mm_storeu_ps(outIm + k, accIm);
+		}
+#endif
+
+		for (; k < DPAR_HRTF_FFT; ++k) {
+			outRe[k] += xr[k] * hr[k] - xi[k] * hi[k];
+			outIm[k] += xr[k] * hi[k] + xi[k] * hr[k];
+		}
+	}
+}
+
+void Spatializer::processBlock(Convolver& conv) {
+	// Push the spectrum of the latest two blocks into the delay line (overlap-save)
+	conv.fdlHead = (conv.fdlHead + 1) % DPAR_HRTF_PARTITIONS;
+	memcpy(conv.fdlRe[conv.fdlHead], conv.window, sizeof(conv.window));
+	memset(conv.fdlIm[conv.fdlHead], 0, sizeof(conv.fdlIm[conv.fdlHead]));
+	fft.transform(conv.fdlRe[conv.fdlHead], conv.fdlIm[conv.fdlHead], false);
+
+	conv.direction = dpar_directionForAzimuth(azimuths[conv.clientID].load(std::memory_order_relaxed));
+
+	accumulate(conv, conv.direction, scratchRe, scratchIm);
+	fft.transform(scratchRe, scratchIm, true);
+
+	if (conv.direction != conv.previousDirection) {
+		// Render the block with the old HRIR too and crossfade so direction changes don't click
+		accumulate(conv, conv.previousDirection, fadeRe, fadeIm);
+		fft.transform(fadeRe, fadeIm, true);
+
+		for (int i = 0; i < DPAR_HRTF_BLOCK; ++i) {
+			const float t = (float)(i + 1) / DPAR_HRTF_BLOCK;
+			conv.outLeft[i] = fadeRe[DPAR_HRTF_BLOCK + i] * (1.0f - t) + scratchRe[DPAR_HRTF_BLOCK + i] * t;
+			conv.outRight[i] = fadeIm[DPAR_HRTF_BLOCK + i] * (1.0f - t) + scratchIm[DPAR_HRTF_BLOCK + i] * t;
+		}
+		conv.previousDirection = conv.direction;
+	}
+	else {
+		memcpy(conv.outLeft, scratchRe + DPAR_HRTF_BLOCK, sizeof(conv.outLeft));
+		memcpy(conv.outRight, scratchIm + DPAR_HRTF_BLOCK, sizeof(conv.outRight));
+	}
+
+	memcpy(conv.window, conv.window + DPAR_HRTF_BLOCK, sizeof(float) * DPAR_HRTF_BLOCK);
+}
+
+void Spatializer::process(anyID clientID, short* samples, int sampleCount, int channels, const unsigned int* channelSpeakerArray, unsigned int* channelFillMask) {
+	if (convolvers.empty() || sampleCount > (int)mono.size()) {
+		return;
+	}
+
+	int left = -1;
+	int right = -1;
+	for (int c = 0; c < channels && c < 32; ++c) {
+		if (channelSpeakerArray[c] == SPEAKER_FRONT_LEFT || channelSpeakerArray[c] == SPEAKER_HEADPHONES_LEFT) {
+			left = c;
+		}
+		else if (channelSpeakerArray[c] == SPEAKER_FRONT_RIGHT || channelSpeakerArray[c] == SPEAKER_HEADPHONES_RIGHT) {
+			right = c;
+		}
+	}
+	if (left < 0 || right < 0) {
+		// Nothing to render binaural audio into, leave TeamSpeak's panning in place
+		return;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	++frameCounter;
+
+	// Undo TeamSpeak's panning by folding the filled channels back down to mono
+	int filled = 0;
+	for (int c = 0; c < channels && c < 32; ++c) {
+		if (*channelFillMask & (1u << c)) {
+			++filled;
+		}
+	}
+	const float downmixGain = filled > 0 ? 1.0f / sqrtf((float)filled) : 0.0f;
+	for (int i = 0; i < sampleCount; ++i) {
+		float sum = 0.0f;
+		for (int c = 0; c < channels && c < 32; ++c) {
+			if (*channelFillMask & (1u << c)) {
+				sum += samples[i * channels + c];
+			}
+		}
+		mono[i] = sum * downmixGain;
+	}
+
+	Convolver& conv = convolverFor(clientID);
+	conv.resting = false;
+	int blocks = 0;
+
+	for (int i = 0; i < sampleCount; ++i) {
+		short* frame = samples + i * channels;
+		memset(frame, 0, sizeof(short) * channels);
+		frame[left] = dpar_saturate(conv.outLeft[conv.fill]);
+		frame[right] = dpar_saturate(conv.outRight[conv.fill]);
+
+		conv.window[DPAR_HRTF_BLOCK + conv.fill] = mono[i];
+		if (++conv.fill == DPAR_HRTF_BLOCK) {
+			processBlock(conv);
+			conv.fill = 0;
+			++blocks;
+		}
+	}
+
+	*channelFillMask = (1u << left) | (1u << right);
+
+	if (blocks > 0) {
+		const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+		measuredBlocks.fetch_add(blocks, std::memory_order_relaxed);
+		measuredNanoseconds.fetch_add(elapsed.count(), std::memory_order_relaxed);
+	}
+}
+
+void Spatializer::rest(anyID clientID) {
+	unsigned char slot = slotOf[clientID];
+	if (slot >= convolvers.size() || !convolvers[slot].active || convolvers[slot].clientID != clientID) {
+		return;
+	}
+
+	Convolver& conv = convolvers[slot];
+	if (conv.resting) {
+		return;
+	}
+
+	// Start from silence when the talker comes back rather than replaying a stale block
+	memset(conv.window, 0, sizeof(conv.window));
+	memset(conv.fdlRe, 0, sizeof(conv.fdlRe));
+	memset(conv.fdlIm, 0, sizeof(conv.fdlIm));
+	memset(conv.outLeft, 0, sizeof(conv.outLeft));
+	memset(conv.outRight, 0, sizeof(conv.outRight));
+	conv.fill = 0;
+	conv.resting = true;
+}
+
+double Spatializer::averageBlockMicroseconds() const {
+	const unsigned long long blocks = measuredBlocks.load(std::memory_order_relaxed);
+	if (blocks == 0) {
+		return 0.0;
+	}
+	return measuredNanoseconds.load(std::memory_order_relaxed) / 1000.0 / blocks;
+}
@@ -0,0 +1,120 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Binaural spatializer: convolves each talker with a head related impulse response
+ * pair picked from the talker's direction relative to the listener
+ */
+
+#ifndef DPAR_HRTF_H
+#define DPAR_HRTF_H
+
+#include <atomic>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+#include "dpar_audio.hpp"
+
+#define DPAR_HRTF_SAMPLE_RATE 48000
+#define DPAR_HRTF_BLOCK 128                                    // Partition size, also the added latency in samples
+#define DPAR_HRTF_FFT (2 * DPAR_HRTF_BLOCK)
+#define DPAR_HRTF_LENGTH 256                                   // HRIR taps
+#define DPAR_HRTF_PARTITIONS (DPAR_HRTF_LENGTH / DPAR_HRTF_BLOCK)
+#define DPAR_HRTF_DIRECTIONS 24                                // 15 degree azimuth steps
+#define DPAR_HRTF_MAX_TALKERS 32
+
+/* Iterative radix-2 complex FFT on split real/imaginary arrays */
+class Fft {
+	int n;
+	std::vector<float> cosTable;
+	std::vector<float> sinTable;
+	std::vector<int> bitReverse;
+
+	public:
+		explicit Fft(int size);
+
+		int size() const { return n; }
+
+		// In place, the inverse is unscaled
+		void transform(float* re, float* im, bool inverse) const;
+};
+
+/*
+ * HRIR pairs for each azimuth, stored per partition in the frequency domain.
+ * Left and right ears are packed into one complex filter (left + i*right) so a single
+ * complex multiply and inverse FFT produces both ear signals.
+ */
+class HrirSet {
+	std::vector<float> re;
+	std::vector<float> im;
+
+	public:
+		HrirSet();
+
+		// Builds the set from a spherical head model (interaural delay, head shadow and a rear high frequency cut)
+		void generate(const Fft& fft);
+
+		const float* partitionRe(int direction, int partition) const;
+		const float* partitionIm(int direction, int partition) const;
+};
+
+class Spatializer {
+	struct Convolver {
+		anyID clientID;
+		bool active;
+		bool resting;                                          // Buffers cleared while the talker is silent
+		unsigned long long lastUsed;
+
+		int direction;
+		int previousDirection;
+
+		float window[DPAR_HRTF_FFT];                           // Previous block followed by the current block
+		float fdlRe[DPAR_HRTF_PARTITIONS][DPAR_HRTF_FFT];      // Frequency domain delay line of input spectra
+		float fdlIm[DPAR_HRTF_PARTITIONS][DPAR_HRTF_FFT];
+		int fdlHead;
+
+		int fill;                                              // Samples of the current block received so far
+		float outLeft[DPAR_HRTF_BLOCK];
+		float outRight[DPAR_HRTF_BLOCK];
+	};
+
+	Fft fft;
+	HrirSet hrirs;
+	std::vector<Convolver> convolvers;
+	unsigned char slotOf[DPAR_MAX_CLIENTS];
+	unsigned long long frameCounter;
+
+	std::atomic<float> azimuths[DPAR_MAX_CLIENTS];
+
+	// Scratch space for a block, only used from the playback thread
+	float scratchRe[DPAR_HRTF_FFT];
+	float scratchIm[DPAR_HRTF_FFT];
+	float fadeRe[DPAR_HRTF_FFT];
+	float fadeIm[DPAR_HRTF_FFT];
+	std::vector<float> mono;
+
+	std::atomic<unsigned long long> measuredBlocks;
+	std::atomic<unsigned long long> measuredNanoseconds;
+
+	Convolver& convolverFor(anyID clientID);
+	void processBlock(Convolver& conv);
+	void accumulate(const Convolver& conv, int direction, float* outRe, float* outIm);
+
+	public:
+		Spatializer();
+
+		// Allocates the convolvers and generates the HRIR set, call once before audio starts
+		void init(int maxFrameSamples);
+
+		// Azimuth of the talker relative to where the listener faces, radians, positive to the right
+		void setDirection(anyID clientID, float azimuth);
+
+		// Replaces the client's post processed output with the binaural rendering on the front left/right channels
+		void process(anyID clientID, short* samples, int sampleCount, int channels, const unsigned int* channelSpeakerArray, unsigned int* channelFillMask);
+
+		// Drops the talker's convolution state while their frames are skipped as silent
+		void rest(anyID clientID);
+
+		// Average cost of rendering one block (DPAR_HRTF_BLOCK samples) for one talker
+		double averageBlockMicroseconds() const;
+};
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <string.h>
+#include "dpar_join.hpp"
+
+// Unique identifiers are base64, widening through unsigned char gives the same units whether the string is narrow or wide
+static uint32_t dpar_codeUnit(char c) {
+	return (unsigned char)c;
+}
+
+static uint32_t dpar_codeUnit(wchar_t c) {
+	return (uint32_t)c;
+}
+
+// 64 bit FNV-1a over the code units
+template<typename C>
+static uint64_t dpar_hashUID(const C* uid, size_t length) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= dpar_codeUnit(uid[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Compared unit by unit so the client's UID doesn't have to be converted to check a match
+static bool dpar_sameUID(const utility::string_t& key, const char* uid, size_t length) {
+	if (key.size() != length) {
+		return false;
+	}
+	for (size_t i = 0; i < length; ++i) {
+		if (dpar_codeUnit(key[i]) != dpar_codeUnit(uid[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void PlayerIndex::build(const web::json::object& players) {
+	records.clear();
+
+	size_t capacity = 16;
+	while (capacity < players.size() * 2) {
+		capacity <<= 1;
+	}
+	Slot empty;
+	empty.hash = 0;
+	empty.record = -1;
+	slots.assign(capacity, empty);
+
+	const size_t mask = capacity - 1;
+	for (web::json::object::const_iterator it = players.begin(); it != players.end(); ++it) {
+		const uint64_t hash = dpar_hashUID(it->first.c_str(), it->first.size());
+		size_t i = (size_t)hash & mask;
+		while (slots[i].record >= 0) {
+			i = (i + 1) & mask;
+		}
+
+		Record record;
+		record.uid = &it->first;
+		record.player = &it->second;
+		slots[i].hash = hash;
+		slots[i].record = (int32_t)records.size();
+		records.push_back(record);
+	}
+}
+
+const web::json::value* PlayerIndex::find(const char* uid) const {
+	if (slots.empty()) {
+		return NULL;
+	}
+
+	const size_t length = strlen(uid);
+	const uint64_t hash = dpar_hashUID(uid, length);
+	const size_t mask = slots.size() - 1;
+	for (size_t i = (size_t)hash & mask; slots[i].record >= 0; i = (i + 1) & mask) {
+		if (slots[i].hash == hash && dpar_sameUID(*records[slots[i].record].uid, uid, length)) {
+			return records[slots[i].record].player;
+		}
+	}
+	return NULL;
+}
+
+size_t PlayerIndex::size() const {
+	return records.size();
+}
@@ -0,0 +1,41 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Index from a client's unique identifier to its record in a position response. cpprest's
+ * json::object finds a key by searching its vector of fields and operator[] inserts one when
+ * it's missing, so the index is built once per response and each client costs one probe
+ */
+
+#ifndef DPAR_JOIN_H
+#define DPAR_JOIN_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "cpprest/json.h"
+
+class PlayerIndex {
+	struct Slot {
+		uint64_t hash;
+		int32_t record;   // Into records, -1 while the slot is empty
+	};
+
+	struct Record {
+		const utility::string_t* uid;
+		const web::json::value* player;
+	};
+
+	std::vector<Slot> slots;      // Power of two, kept at most half full
+	std::vector<Record> records;
+
+	public:
+		// Indexes every field of players, which must outlive the index. Reuses the table from the last build
+		void build(const web::json::object& players);
+
+		// Record for a unique identifier, NULL if the response has none
+		const web::json::value* find(const char* uid) const;
+
+		size_t size() const;
+};
+
+#endif
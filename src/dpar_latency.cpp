@@ -0,0 +1,328 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "dpar_latency.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DPAR_HAVE_TSC
+#endif
+
+// Log-linear buckets: 2^SUB linear sub buckets per power of two, so each bucket is within 1/16 of its value
+#define DPAR_LATENCY_SUB_BITS 4
+#define DPAR_LATENCY_SUB_BUCKETS (1 << DPAR_LATENCY_SUB_BITS)
+#define DPAR_LATENCY_ROWS 64
+#define DPAR_LATENCY_BUCKETS (DPAR_LATENCY_ROWS * DPAR_LATENCY_SUB_BUCKETS)
+
+static const char* ProbeNames[DPAR_PROBE_COUNT] = { "rolloff", "playback", "postprocess", "mixed" };
+
+/* Histograms written by a single thread, read by the aggregator */
+struct LatencySlab {
+	std::atomic<uint64_t> counts[DPAR_PROBE_COUNT][DPAR_LATENCY_BUCKETS];
+
+	LatencySlab() {
+		for (int p = 0; p < DPAR_PROBE_COUNT; ++p) {
+			for (int b = 0; b < DPAR_LATENCY_BUCKETS; ++b) {
+				counts[p][b].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+};
+
+/* A thread that records, its slab is swapped out rather than cleared so the thread never races a reset */
+struct LatencyThread {
+	std::atomic<LatencySlab*> slab;
+	std::atomic<uint64_t> recorded;   // Bumped after every measurement, once it moves a swapped out slab is no longer written
+	std::atomic<bool> exited;
+
+	LatencyThread() : slab(new LatencySlab()), recorded(0), exited(false) {}
+};
+
+/* Slab swapped out by a reset, freed once its thread has finished any measurement still writing it */
+struct RetiredSlab {
+	LatencySlab* slab;
+	LatencyThread* thread;
+	uint64_t recordedAt;
+};
+
+/* Flags the thread's record when the thread exits, the aggregator then folds it in and frees it */
+struct LatencyThreadOwner {
+	LatencyThread* thread;
+
+	LatencyThreadOwner() : thread(NULL) {}
+	~LatencyThreadOwner() {
+		if (thread != NULL) {
+			thread->exited.store(true);
+		}
+	}
+};
+
+static std::mutex SlabsMutex;
+static std::vector<LatencyThread*> Threads;
+static std::vector<RetiredSlab> Retired;
+static uint64_t ExitedTotals[DPAR_PROBE_COUNT][DPAR_LATENCY_BUCKETS];   // Counts from threads that have exited since the last reset
+static thread_local LatencyThreadOwner ThreadOwner;
+
+static std::mutex SummaryMutex;
+static std::string Summary = "No latency data yet";
+
+static std::mutex AggregatorMutex;
+static std::condition_variable AggregatorWake;
+static bool AggregatorStopping = false;
+static std::thread Aggregator;
+
+// Ticks per nanosecond, measured by the aggregator against the steady clock
+static double TicksPerNanosecond = 1.0;
+
+uint64_t dpar_latencyNow() {
+#if defined(DPAR_HAVE_TSC) && defined(_MSC_VER)
+	return __rdtsc();
+#elif defined(DPAR_HAVE_TSC)
+	return __builtin_ia32_rdtsc();
+#else
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static int dpar_highestBit(uint64_t v) {
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, v);
+	return (int)index;
+#elif defined(__GNUC__)
+	return 63 - __builtin_clzll(v);
+#else
+	int index = 0;
+	while (v >>= 1) {
+		++index;
+	}
+	return index;
+#endif
+}
+
+static int dpar_bucketFor(uint64_t ticks) {
+	if (ticks < DPAR_LATENCY_SUB_BUCKETS) {
+		return (int)ticks;
+	}
+
+	const int msb = dpar_highestBit(ticks);
+	const int row = msb - DPAR_LATENCY_SUB_BITS + 1;
+	if (row >= DPAR_LATENCY_ROWS) {
+		return DPAR_LATENCY_BUCKETS - 1;
+	}
+
+	const int sub = (int)(ticks >> (msb - DPAR_LATENCY_SUB_BITS)) & (DPAR_LATENCY_SUB_BUCKETS - 1);
+	return (row << DPAR_LATENCY_SUB_BITS) | sub;
+}
+
+// Middle of the range of ticks a bucket covers
+static double dpar_bucketValue(int bucket) {
+	if (bucket < DPAR_LATENCY_SUB_BUCKETS) {
+		return (double)bucket;
+	}
+
+	const int row = bucket >> DPAR_LATENCY_SUB_BITS;
+	const int sub = bucket & (DPAR_LATENCY_SUB_BUCKETS - 1);
+	const int shift = row - 1;
+	const double lower = (double)(DPAR_LATENCY_SUB_BUCKETS + sub) * (double)(1ULL << shift);
+	return lower + (double)(1ULL << shift) / 2.0;
+}
+
+void dpar_recordLatency(DparProbe probe, uint64_t ticks) {
+	LatencyThread* thread = ThreadOwner.thread;
+	if (thread == NULL) {
+		// First measurement on this thread, the only time recording allocates or locks
+		thread = new LatencyThread();
+		std::lock_guard<std::mutex> lock(SlabsMutex);
+		Threads.push_back(thread);
+		ThreadOwner.thread = thread;
+	}
+
+	// Only this thread writes the slab so a plain load and store is enough
+	LatencySlab* slab = thread->slab.load();
+	std::atomic<uint64_t>& count = slab->counts[probe][dpar_bucketFor(ticks)];
+	count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	// Released after the write, a reset seeing this move knows the slab it swapped out is done with
+	thread->recorded.store(thread->recorded.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void dpar_latencyReset() {
+	std::lock_guard<std::mutex> lock(SlabsMutex);
+	for (size_t i = 0; i < Threads.size(); ++i) {
+		// Swapped rather than cleared, a measurement in flight lands in the old slab which is then thrown away
+		RetiredSlab retired;
+		retired.thread = Threads[i];
+		retired.slab = Threads[i]->slab.exchange(new LatencySlab());
+		retired.recordedAt = Threads[i]->recorded.load(std::memory_order_acquire);
+		Retired.push_back(retired);
+	}
+
+	for (int p = 0; p < DPAR_PROBE_COUNT; ++p) {
+		for (int b = 0; b < DPAR_LATENCY_BUCKETS; ++b) {
+			ExitedTotals[p][b] = 0;
+		}
+	}
+}
+
+// Frees slabs no thread can still be writing and folds exited threads into ExitedTotals. Called with SlabsMutex held
+static void dpar_latencyReclaim() {
+	for (size_t i = 0; i < Retired.size();) {
+		const LatencyThread* thread = Retired[i].thread;
+		if (thread->exited.load() || thread->recorded.load(std::memory_order_acquire) != Retired[i].recordedAt) {
+			delete Retired[i].slab;
+			Retired[i] = Retired.back();
+			Retired.pop_back();
+		}
+		else {
+			++i;
+		}
+	}
+
+	for (size_t i = 0; i < Threads.size();) {
+		LatencyThread* thread = Threads[i];
+		if (!thread->exited.load()) {
+			++i;
+			continue;
+		}
+
+		// Audio threads come and go as devices are reconfigured, their counts are kept but their memory isn't
+		LatencySlab* slab = thread->slab.load();
+		for (int p = 0; p < DPAR_PROBE_COUNT; ++p) {
+			for (int b = 0; b < DPAR_LATENCY_BUCKETS; ++b) {
+				ExitedTotals[p][b] += slab->counts[p][b].load(std::memory_order_relaxed);
+			}
+		}
+		delete slab;
+		delete thread;
+		Threads[i] = Threads.back();
+		Threads.pop_back();
+	}
+}
+
+static void dpar_latencyAggregate() {
+	static uint64_t totals[DPAR_PROBE_COUNT][DPAR_LATENCY_BUCKETS];
+
+	{
+		std::lock_guard<std::mutex> lock(SlabsMutex);
+		dpar_latencyReclaim();
+
+		for (int p = 0; p < DPAR_PROBE_COUNT; ++p) {
+			for (int b = 0; b < DPAR_LATENCY_BUCKETS; ++b) {
+				totals[p][b] = ExitedTotals[p][b];
+			}
+		}
+		for (size_t i = 0; i < Threads.size(); ++i) {
+			const LatencySlab* slab = Threads[i]->slab.load();
+			for (int p = 0; p < DPAR_PROBE_COUNT; ++p) {
+				for (int b = 0; b < DPAR_LATENCY_BUCKETS; ++b) {
+					totals[p][b] += slab->counts[p][b].load(std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+
+	static const double Percentiles[] = { 0.50, 0.90, 0.99, 0.999 };
+	static const int PercentileCount = sizeof(Percentiles) / sizeof(Percentiles[0]);
+
+	std::string summary;
+	char line[256];
+
+	for (int p = 0; p < DPAR_PROBE_COUNT; ++p) {
+		uint64_t count = 0;
+		int highest = -1;
+		for (int b = 0; b < DPAR_LATENCY_BUCKETS; ++b) {
+			count += totals[p][b];
+			if (totals[p][b] > 0) {
+				highest = b;
+			}
+		}
+
+		if (count == 0) {
+			snprintf(line, sizeof(line), "%s: no samples\n", ProbeNames[p]);
+			summary += line;
+			continue;
+		}
+
+		double values[PercentileCount];
+		int next = 0;
+		uint64_t seen = 0;
+		for (int b = 0; b < DPAR_LATENCY_BUCKETS && next < PercentileCount; ++b) {
+			seen += totals[p][b];
+			while (next < PercentileCount && seen >= (uint64_t)(Percentiles[next] * count + 0.5)) {
+				values[next++] = dpar_bucketValue(b);
+			}
+		}
+		while (next < PercentileCount) {
+			values[next++] = dpar_bucketValue(highest);
+		}
+
+		const double toMicroseconds = 1.0 / (TicksPerNanosecond * 1000.0);
+		snprintf(line, sizeof(line), "%s: n=%llu p50=%.2fus p90=%.2fus p99=%.2fus p99.9=%.2fus max=%.2fus\n",
+			ProbeNames[p], (unsigned long long)count,
+			values[0] * toMicroseconds, values[1] * toMicroseconds, values[2] * toMicroseconds, values[3] * toMicroseconds,
+			dpar_bucketValue(highest) * toMicroseconds);
+		summary += line;
+	}
+
+	std::lock_guard<std::mutex> lock(SummaryMutex);
+	Summary = summary;
+}
+
+void dpar_latencyStart() {
+	std::lock_guard<std::mutex> lock(AggregatorMutex);
+	if (Aggregator.joinable()) {
+		return;
+	}
+	AggregatorStopping = false;
+
+	Aggregator = std::thread([]() {
+		const uint64_t startTicks = dpar_latencyNow();
+		const auto startTime = std::chrono::steady_clock::now();
+
+		std::unique_lock<std::mutex> lock(AggregatorMutex);
+		while (!AggregatorStopping) {
+			AggregatorWake.wait_for(lock, std::chrono::seconds(1));
+			if (AggregatorStopping) {
+				break;
+			}
+			lock.unlock();
+
+			const double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+			if (elapsed > 0.0) {
+				TicksPerNanosecond = (double)(dpar_latencyNow() - startTicks) / elapsed;
+			}
+			dpar_latencyAggregate();
+
+			lock.lock();
+		}
+	});
+}
+
+void dpar_latencyStop() {
+	{
+		std::lock_guard<std::mutex> lock(AggregatorMutex);
+		AggregatorStopping = true;
+	}
+	AggregatorWake.notify_all();
+
+	if (Aggregator.joinable()) {
+		Aggregator.join();
+	}
+}
+
+std::string dpar_latencySummary() {
+	std::lock_guard<std::mutex> lock(SummaryMutex);
+	return Summary;
+}
@@ -0,0 +1,49 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Latency histograms for the audio callbacks. Recording is a timestamp and one bucket
+ * increment into a histogram owned by the calling thread, a background thread sums the
+ * per thread histograms and works out the percentiles.
+ */
+
+#ifndef DPAR_LATENCY_H
+#define DPAR_LATENCY_H
+
+#include <stdint.h>
+#include <string>
+
+enum DparProbe {
+	DPAR_PROBE_ROLLOFF = 0,
+	DPAR_PROBE_PLAYBACK,
+	DPAR_PROBE_POSTPROCESS,
+	DPAR_PROBE_MIXED,
+	DPAR_PROBE_COUNT
+};
+
+// Raw timestamp, CPU ticks where available, converted to time only when aggregating
+uint64_t dpar_latencyNow();
+
+// Adds one measurement (in dpar_latencyNow ticks) to the calling thread's histogram
+void dpar_recordLatency(DparProbe probe, uint64_t ticks);
+
+// Starts and stops the background aggregation thread
+void dpar_latencyStart();
+void dpar_latencyStop();
+
+// Clears every histogram
+void dpar_latencyReset();
+
+// Percentile summary of every probe as of the last aggregation, one probe per line
+std::string dpar_latencySummary();
+
+/* Times the enclosing scope into a probe */
+class LatencyScope {
+	DparProbe probe;
+	uint64_t start;
+
+	public:
+		explicit LatencyScope(DparProbe p) : probe(p), start(dpar_latencyNow()) {}
+		~LatencyScope() { dpar_recordLatency(probe, dpar_latencyNow() - start); }
+};
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include "dpar_mute.hpp"
+
+void MuteManager::begin(std::chrono::steady_clock::time_point now) {
+	std::lock_guard<std::mutex> lock(mutex);
+	tickTime = now;
+	seen.clear();
+	toMute.clear();
+	toUnmute.clear();
+}
+
+void MuteManager::consider(anyID clientID, float distance, float cutoff, unsigned int reasons, bool mutedNow) {
+	std::lock_guard<std::mutex> lock(mutex);
+	seen.insert(clientID);
+
+	std::map<anyID, OurMute>::iterator ours = muted.find(clientID);
+
+	if (ours != muted.end() ? distance >= cutoff * DPAR_MUTE_RELEASE : distance > cutoff * DPAR_MUTE_ENGAGE) {
+		reasons |= DPAR_MUTE_OUT_OF_RANGE;
+	}
+
+	if (ours != muted.end()) {
+		if (mutedNow) {
+			ours->second.confirmed = true;
+		}
+		else if (ours->second.confirmed) {
+			// The user unmuted them, that wins until they come back into range
+			muted.erase(ours);
+			overridden.insert(clientID);
+			return;
+		}
+		else if (tickTime - ours->second.requested > std::chrono::milliseconds(DPAR_MUTE_GRACE_MS)) {
+			// Our request never took, forgotten so it's sent again below if they still need muting
+			muted.erase(ours);
+			ours = muted.end();
+		}
+	}
+
+	if (ours != muted.end()) {
+		if (reasons == 0) {
+			muted.erase(ours);
+			toUnmute.push_back(clientID);
+		}
+		else {
+			ours->second.reasons = reasons;
+		}
+		return;
+	}
+
+	if (reasons == 0) {
+		overridden.erase(clientID);
+		return;
+	}
+
+	// Either the user's own mute or one of ours they undid
+	if (mutedNow || overridden.count(clientID)) {
+		return;
+	}
+
+	OurMute& mute = muted[clientID];
+	mute.reasons = reasons;
+	mute.confirmed = false;
+	mute.requested = tickTime;
+	toMute.push_back(clientID);
+}
+
+void MuteManager::commit(std::pmr::vector<anyID>& mute, std::pmr::vector<anyID>& unmute) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (std::map<anyID, OurMute>::iterator it = muted.begin(); it != muted.end();) {
+		if (seen.count(it->first)) {
+			++it;
+			continue;
+		}
+		toUnmute.push_back(it->first);
+		it = muted.erase(it);
+	}
+
+	// Copied out rather than swapped so the lists here keep their capacity and the caller's stay in its arena
+	mute.assign(toMute.begin(), toMute.end());
+	unmute.assign(toUnmute.begin(), toUnmute.end());
+	toMute.clear();
+	toUnmute.clear();
+}
+
+std::vector<anyID> MuteManager::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<anyID> ours;
+	for (std::map<anyID, OurMute>::const_iterator it = muted.begin(); it != muted.end(); ++it) {
+		ours.push_back(it->first);
+	}
+	muted.clear();
+	overridden.clear();
+	seen.clear();
+	toMute.clear();
+	toUnmute.clear();
+	return ours;
+}
+
+size_t MuteManager::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return muted.size();
+}
@@ -0,0 +1,68 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Automatic muting of talkers we couldn't hear anyway. A muted client's voice isn't sent to
+ * us at all, saving the bandwidth and the decode. Only clients we muted ourselves are ever
+ * unmuted, the user's own mutes are left alone.
+ */
+
+#ifndef DPAR_MUTE_H
+#define DPAR_MUTE_H
+
+#include <chrono>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+// Why we muted a client, a client is unmuted once it has no reasons left
+#define DPAR_MUTE_OUT_OF_RANGE 0x1
+#define DPAR_MUTE_OTHER_CHANNEL 0x2
+#define DPAR_MUTE_OVER_BUDGET 0x4
+
+// Talkers are muted beyond this multiple of the cutoff and unmuted again inside the smaller one,
+// early enough for the unmute to reach the server before they become audible
+#define DPAR_MUTE_ENGAGE 1.25f
+#define DPAR_MUTE_RELEASE 1.1f
+
+// How long a mute we asked for has to show up in CLIENT_IS_MUTED. Until it has, the client still reading unmuted
+// is our request in flight rather than the user undoing it, and past this it's taken to have been lost
+#define DPAR_MUTE_GRACE_MS 2000
+
+/* A client we muted */
+struct OurMute {
+	unsigned int reasons;
+	bool confirmed;                                  // TeamSpeak has reported them muted since we asked
+	std::chrono::steady_clock::time_point requested;
+};
+
+class MuteManager {
+	std::mutex mutex;
+	std::map<anyID, OurMute> muted;       // Clients we muted
+	std::set<anyID> overridden;           // Unmuted by the user while we had them muted, left alone until back in range
+	std::set<anyID> seen;                 // Considered during the current tick
+	std::vector<anyID> toMute;
+	std::vector<anyID> toUnmute;
+	std::chrono::steady_clock::time_point tickTime;
+
+	public:
+		// Starts a tick at now
+		void begin(std::chrono::steady_clock::time_point now);
+
+		// Offers a talker we have a position for, with any reasons other than distance to mute them. mutedNow is whether
+		// TeamSpeak has them muted at the moment, which tells the user's mutes (and the user unmuting one of ours) apart from our own
+		void consider(anyID clientID, float distance, float cutoff, unsigned int reasons, bool mutedNow);
+
+		// Ends the tick with the clients to mute and unmute. Clients we muted that weren't considered this tick have
+		// left the channel or can't be placed any more, so they're unmuted too
+		void commit(std::pmr::vector<anyID>& mute, std::pmr::vector<anyID>& unmute);
+
+		// Forgets every client, returning the ones we muted so they can be unmuted
+		std::vector<anyID> reset();
+
+		size_t size();
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <math.h>
+#include "dpar_players.hpp"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DPAR_SSE2
+#include <emmintrin.h>
+#endif
+
+void PlayerStore::clear() {
+	clients.clear();
+	xs.clear();
+	ys.clear();
+	zs.clear();
+	yaws.clear();
+	channels.clear();
+	locals.clear();
+	distances.clear();
+}
+
+size_t PlayerStore::add(anyID clientID, float x, float y, float z, float yaw, int32_t channel, bool local) {
+	clients.push_back(clientID);
+	xs.push_back(x);
+	ys.push_back(y);
+	zs.push_back(z);
+	yaws.push_back(yaw);
+	channels.push_back(channel);
+	locals.push_back(local ? 0xFFFFFFFFu : 0u);
+	distances.push_back(0.0f);
+	return clients.size() - 1;
+}
+
+size_t PlayerStore::size() const {
+	return clients.size();
+}
+
+void PlayerStore::transform() {
+	const size_t n = clients.size();
+	float* x = xs.data();
+	float* y = ys.data();
+	float* z = zs.data();
+	const uint32_t* local = locals.data();
+	size_t i = 0;
+
+#ifdef DPAR_SSE2
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	for (; i + 4 <= n; i += 4) {
+		const __m128 keep = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(local + i)));
+
+		// Masking with keep zeroes the lanes of players that aren't in local mode
+		_mm_storeu_ps(x + i, _mm_and_ps(keep, _mm_xor_ps(_mm_loadu_ps(x + i), signBit)));
+		_mm_storeu_ps(y + i, _mm_and_ps(keep, _mm_loadu_ps(y + i)));
+		_mm_storeu_ps(z + i, _mm_and_ps(keep, _mm_loadu_ps(z + i)));
+	}
+#endif
+
+	for (; i < n; ++i) {
+		if (local[i]) {
+			x[i] = -x[i];
+		}
+		else {
+			x[i] = 0.0f;
+			y[i] = 0.0f;
+			z[i] = 0.0f;
+		}
+	}
+}
+
+void PlayerStore::measure(const TS3_VECTOR& center) {
+	const size_t n = clients.size();
+	const float* x = xs.data();
+	const float* y = ys.data();
+	const float* z = zs.data();
+	float* d = distances.data();
+	size_t i = 0;
+
+#ifdef DPAR_SSE2
+	const __m128 cx = _mm_set1_ps(center.x);
+	const __m128 cy = _mm_set1_ps(center.y);
+	const __m128 cz = _mm_set1_ps(center.z);
+	for (; i + 4 <= n; i += 4) {
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), cx);
+		const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), cy);
+		const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), cz);
+		const __m128 squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		_mm_storeu_ps(d + i, _mm_sqrt_ps(squared));
+	}
+#endif
+
+	for (; i < n; ++i) {
+		const float dx = x[i] - center.x;
+		const float dy = y[i] - center.y;
+		const float dz = z[i] - center.z;
+		d[i] = sqrtf(dx * dx + dy * dy + dz * dz);
+	}
+}
+
+void PlayerStore::rangeMask(float radius, std::pmr::vector<uint8_t>& mask) const {
+	const size_t n = clients.size();
+	const float* d = distances.data();
+	mask.resize(n);
+	size_t i = 0;
+
+#ifdef DPAR_SSE2
+	const __m128 limit = _mm_set1_ps(radius);
+	for (; i + 4 <= n; i += 4) {
+		const int bits = _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(d + i), limit));
+		mask[i] = (uint8_t)(bits & 1);
+		mask[i + 1] = (uint8_t)((bits >> 1) & 1);
+		mask[i + 2] = (uint8_t)((bits >> 2) & 1);
+		mask[i + 3] = (uint8_t)((bits >> 3) & 1);
+	}
+#endif
+
+	for (; i < n; ++i) {
+		mask[i] = d[i] <= radius ? 1 : 0;
+	}
+}
+
+void PlayerStore::audibleMask(const ChannelSet& hears, std::pmr::vector<uint8_t>& mask) const {
+	const size_t n = clients.size();
+	mask.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		mask[i] = hears.contains(channels[i]) ? 1 : 0;
+	}
+}
+
+TS3_VECTOR PlayerStore::position(size_t i) const {
+	TS3_VECTOR p;
+	p.x = xs[i];
+	p.y = ys[i];
+	p.z = zs[i];
+	return p;
+}
@@ -0,0 +1,56 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Placed players from a position response, held as one array per field so the per tick
+ * transform and distance math run over contiguous floats a few lanes at a time
+ */
+
+#ifndef DPAR_PLAYERS_H
+#define DPAR_PLAYERS_H
+
+#include <memory_resource>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+#include "dpar_audibility.hpp"
+
+class PlayerStore {
+	std::vector<anyID> clients;
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<float> zs;
+	std::vector<float> yaws;
+	std::vector<int32_t> channels;    // ch.id as the reporting server numbers them
+	std::vector<uint32_t> locals;     // All bits set for "local" mode, 0 for a player heard from the channel origin
+	std::vector<float> distances;     // From the listener, as of the last measure()
+
+	public:
+		// Empties the store, keeping its capacity for the next tick
+		void clear();
+
+		// Appends a player in the game's own coordinates, returns its index
+		size_t add(anyID clientID, float x, float y, float z, float yaw, int32_t channel, bool local);
+
+		size_t size() const;
+
+		// Into TeamSpeak's space: x mirrored for its left handed axes, players not in local mode collapse onto the origin
+		void transform();
+
+		// Distance from center to every player
+		void measure(const TS3_VECTOR& center);
+
+		// One byte per player, 1 if its last measured distance is within radius
+		void rangeMask(float radius, std::pmr::vector<uint8_t>& mask) const;
+
+		// One byte per player, 1 if it's in a channel the listener hears
+		void audibleMask(const ChannelSet& hears, std::pmr::vector<uint8_t>& mask) const;
+
+		anyID client(size_t i) const { return clients[i]; }
+		TS3_VECTOR position(size_t i) const;
+		float yaw(size_t i) const { return yaws[i]; }
+		int32_t channel(size_t i) const { return channels[i]; }
+		float distance(size_t i) const { return distances[i]; }
+};
+
+#endif
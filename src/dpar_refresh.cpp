@@ -0,0 +1,111 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <algorithm>
+#include <math.h>
+#include "dpar_refresh.hpp"
+
+RefreshScheduler::RefreshScheduler() : tick(0), lastSent(0), lastDeferred(0) {
+}
+
+void RefreshScheduler::plan(const PlayerStore& players, const std::pmr::vector<uint8_t>& audible, float nearRadius, int limit, std::pmr::vector<uint8_t>& send) {
+	++tick;
+	const size_t n = players.size();
+	send.assign(n, 0);
+
+	// Talkers that could be skipped this tick, by priority, from the caller's arena
+	std::pmr::vector<std::pair<float, size_t>> candidates(send.get_allocator().resource());
+
+	uint32_t sent = 0;
+	uint32_t waiting = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (!audible[i]) {
+			// Silenced talkers aren't placed, whatever was last pushed is stale by the time they're heard again
+			pushed.erase(players.client(i));
+			continue;
+		}
+
+		const TS3_VECTOR position = players.position(i);
+		std::unordered_map<anyID, Pushed>::iterator last = pushed.find(players.client(i));
+		if (last != pushed.end()) {
+			last->second.seen = tick;
+		}
+
+		if (limit <= 0 || players.distance(i) <= nearRadius) {
+			send[i] = 1;
+			continue;
+		}
+
+		float priority;
+		if (last == pushed.end()) {
+			// Never pushed, TeamSpeak still has it wherever it was left, nearest first among these
+			priority = 1.0e6f;
+		}
+		else {
+			const float dx = position.x - last->second.position.x;
+			const float dy = position.y - last->second.position.y;
+			const float dz = position.z - last->second.position.z;
+			const float moved = sqrtf(dx * dx + dy * dy + dz * dz);
+			const uint32_t age = tick - last->second.tick;
+			priority = (moved > DPAR_REFRESH_STILL ? moved : 0.0f) + DPAR_REFRESH_AGE_WEIGHT * age;
+		}
+
+		// The same movement matters more up close, where it changes the direction and level we hear
+		candidates.push_back(std::make_pair(priority / (players.distance(i) + 1.0f), i));
+	}
+
+	// Near talkers go regardless, whatever the budget has left goes to the highest priority of the rest
+	size_t forced = 0;
+	for (size_t i = 0; i < n; ++i) {
+		forced += send[i];
+	}
+	const size_t room = (size_t)limit > forced ? (size_t)limit - forced : 0;
+	if (candidates.size() > room) {
+		std::nth_element(candidates.begin(), candidates.begin() + room, candidates.end(),
+			[](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; });
+		waiting = (uint32_t)(candidates.size() - room);
+		candidates.resize(room);
+	}
+	for (size_t c = 0; c < candidates.size(); ++c) {
+		send[candidates[c].second] = 1;
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		if (!send[i]) {
+			continue;
+		}
+		Pushed& record = pushed[players.client(i)];
+		record.position = players.position(i);
+		record.tick = tick;
+		record.seen = tick;
+		++sent;
+	}
+
+	// Talkers gone from the channel
+	for (std::unordered_map<anyID, Pushed>::iterator it = pushed.begin(); it != pushed.end();) {
+		if (it->second.seen != tick) {
+			it = pushed.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+
+	lastSent = sent;
+	lastDeferred = waiting;
+}
+
+void RefreshScheduler::reset() {
+	pushed.clear();
+	lastSent = 0;
+	lastDeferred = 0;
+}
+
+uint32_t RefreshScheduler::sentLastTick() const {
+	return lastSent;
+}
+
+uint32_t RefreshScheduler::deferredLastTick() const {
+	return lastDeferred;
+}
@@ -0,0 +1,54 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Apply budget for very large channels. When pushing every talker's position would take more
+ * clientlib calls than a tick allows, talkers near us are always pushed and the rest are picked
+ * by how far they've moved and how long they've waited, so far or still talkers take turns
+ */
+
+#ifndef DPAR_REFRESH_H
+#define DPAR_REFRESH_H
+
+#include <atomic>
+#include <memory_resource>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+#include "dpar_players.hpp"
+
+// Moves shorter than this since the last push don't count as movement
+#define DPAR_REFRESH_STILL 0.05f
+
+// Each tick a talker waits counts as this much movement, so a talker that never moves still gets its turn
+#define DPAR_REFRESH_AGE_WEIGHT 0.25f
+
+class RefreshScheduler {
+	struct Pushed {
+		TS3_VECTOR position;
+		uint32_t tick;      // When it was last pushed
+		uint32_t seen;      // Last tick it was among the players
+	};
+
+	std::unordered_map<anyID, Pushed> pushed;
+	uint32_t tick;
+
+	std::atomic<uint32_t> lastSent;
+	std::atomic<uint32_t> lastDeferred;
+
+	public:
+		RefreshScheduler();
+
+		// Marks in send which of this tick's audible players get their position pushed, taking those as pushed.
+		// Players within nearRadius of the listener always go, the rest by priority until limit pushes (0 for no limit).
+		// Players must already be measured
+		void plan(const PlayerStore& players, const std::pmr::vector<uint8_t>& audible, float nearRadius, int limit, std::pmr::vector<uint8_t>& send);
+
+		// Forgets what was pushed, so everyone goes on the next tick
+		void reset();
+
+		uint32_t sentLastTick() const;
+		uint32_t deferredLastTick() const;
+};
+
+#endif
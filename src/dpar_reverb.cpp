@@ -0,0 +1,291 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <math.h>
+#include <string.h>
+#include "dpar_reverb.hpp"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DPAR_SSE2
+#include <emmintrin.h>
+#endif
+
+#define DPAR_REVERB_SAMPLE_RATE 48000
+#define DPAR_REVERB_MAX_SCALE 1.6f
+
+// Mutually prime line lengths in samples at 48kHz, scaled per environment
+static const int BaseDelays[DPAR_REVERB_LINES] = { 1123, 1289, 1423, 1597, 1741, 1913, 2069, 2237 };
+
+struct ReverbPreset {
+	float scale;     // Room size, multiplies the line lengths
+	float rt60;      // Seconds for the tail to fall by 60dB
+	float damping;   // One pole low pass coefficient in the loop, higher is darker
+	float wet;       // Output level of the reverb
+};
+
+static const ReverbPreset Presets[DPAR_ENV_COUNT] = {
+	{ 1.0f, 0.0f, 0.0f, 0.0f },    // DPAR_ENV_NONE
+	{ 1.6f, 3.5f, 0.3f, 0.6f },    // DPAR_ENV_CAVE
+	{ 1.0f, 0.5f, 0.7f, 0.2f },    // DPAR_ENV_FIELD
+	{ 0.7f, 1.2f, 0.5f, 0.4f },    // DPAR_ENV_BUILDING
+};
+
+DparEnvironment dpar_environmentFromName(const std::string& name) {
+	if (name == "cave") {
+		return DPAR_ENV_CAVE;
+	}
+	if (name == "field") {
+		return DPAR_ENV_FIELD;
+	}
+	if (name == "building") {
+		return DPAR_ENV_BUILDING;
+	}
+	return DPAR_ENV_NONE;
+}
+
+ReverbBus::ReverbBus() : requestedEnvironment(DPAR_ENV_NONE), environment(DPAR_ENV_NONE), maxLineLength(0), damping(0.0f), wetGain(0.0f), sendLength(0), idle(true) {
+	for (int l = 0; l < DPAR_REVERB_LINES; ++l) {
+		lineLength[l] = 1;
+		linePosition[l] = 0;
+		feedbackGain[l] = 0.0f;
+		dampState[l] = 0.0f;
+	}
+	for (int i = 0; i < DPAR_MAX_CLIENTS; ++i) {
+		sendLevels[i].store(0.0f, std::memory_order_relaxed);
+	}
+}
+
+void ReverbBus::init(int maxFrameSamples) {
+	maxLineLength = (int)(BaseDelays[DPAR_REVERB_LINES - 1] * DPAR_REVERB_MAX_SCALE) + 1;
+	delayMemory.assign(DPAR_REVERB_LINES * maxLineLength, 0.0f);
+	sendBuffer.assign(maxFrameSamples, 0.0f);
+	configure(DPAR_ENV_NONE);
+}
+
+void ReverbBus::configure(int env) {
+	const ReverbPreset& preset = Presets[env];
+	environment = env;
+
+	for (int l = 0; l < DPAR_REVERB_LINES; ++l) {
+		int length = (int)(BaseDelays[l] * preset.scale);
+		if (length > maxLineLength) {
+			length = maxLineLength;
+		}
+		lineLength[l] = length;
+		linePosition[l] = 0;
+		dampState[l] = 0.0f;
+		feedbackGain[l] = preset.rt60 > 0.0f ? (float)pow(10.0, -3.0 * length / (preset.rt60 * DPAR_REVERB_SAMPLE_RATE)) : 0.0f;
+	}
+
+	damping = preset.damping;
+	wetGain = preset.wet;
+	idle = true;
+
+	if (!delayMemory.empty()) {
+		memset(&delayMemory[0], 0, sizeof(float) * delayMemory.size());
+	}
+}
+
+void ReverbBus::setEnvironment(DparEnvironment env) {
+	requestedEnvironment.store(env, std::memory_order_relaxed);
+}
+
+bool ReverbBus::enabled() const {
+	return requestedEnvironment.load(std::memory_order_relaxed) != DPAR_ENV_NONE;
+}
+
+void ReverbBus::setSendDistance(anyID clientID, float normalizedDistance) {
+	if (normalizedDistance < 0.0f) {
+		normalizedDistance = 0.0f;
+	}
+	else if (normalizedDistance > 1.0f) {
+		normalizedDistance = 1.0f;
+	}
+
+	// Far talkers are heard mostly through the room, close ones mostly direct
+	sendLevels[clientID].store(0.15f + 0.85f * normalizedDistance, std::memory_order_relaxed);
+}
+
+void ReverbBus::send(anyID clientID, const short* samples, int sampleCount, int channels, unsigned int channelFillMask) {
+	if (!enabled() || sampleCount > (int)sendBuffer.size()) {
+		return;
+	}
+
+	const float level = sendLevels[clientID].load(std::memory_order_relaxed);
+	if (level <= 0.0f || channelFillMask == 0) {
+		return;
+	}
+
+	for (int i = 0; i < sampleCount; ++i) {
+		float sum = 0.0f;
+		for (int c = 0; c < channels && c < 32; ++c) {
+			if (channelFillMask & (1u << c)) {
+				sum += samples[i * channels + c];
+			}
+		}
+		sendBuffer[i] += sum * level;
+	}
+
+	if (sampleCount > sendLength) {
+		sendLength = sampleCount;
+	}
+	idle = false;
+}
+
+static inline short dpar_mixSaturate(short dry, float wet) {
+	float v = (float)dry + wet;
+	if (v > 32767.0f) {
+		return 32767;
+	}
+	if (v < -32768.0f) {
+		return -32768;
+	}
+	return (short)(v >= 0.0f ? v + 0.5f : v - 0.5f);
+}
+
+void ReverbBus::process(short* samples, int sampleCount, int channels, const unsigned int* channelSpeakerArray, unsigned int* channelFillMask) {
+	const int requested = requestedEnvironment.load(std::memory_order_relaxed);
+	if (requested != environment) {
+		configure(requested);
+	}
+
+	if (idle && sendLength == 0) {
+		return;
+	}
+
+	if (environment == DPAR_ENV_NONE || delayMemory.empty() || sampleCount > (int)sendBuffer.size()) {
+		if (sendLength > 0) {
+			memset(&sendBuffer[0], 0, sizeof(float) * sendLength);
+			sendLength = 0;
+		}
+		return;
+	}
+
+	int left = -1;
+	int right = -1;
+	for (int c = 0; c < channels && c < 32; ++c) {
+		if (channelSpeakerArray[c] == SPEAKER_FRONT_LEFT || channelSpeakerArray[c] == SPEAKER_HEADPHONES_LEFT) {
+			left = c;
+		}
+		else if (channelSpeakerArray[c] == SPEAKER_FRONT_RIGHT || channelSpeakerArray[c] == SPEAKER_HEADPHONES_RIGHT) {
+			right = c;
+		}
+	}
+	if (left < 0 || right < 0) {
+		// Mono output, fold both reverb outputs into the first channel
+		left = 0;
+		right = 0;
+	}
+
+	const float inputGain = 0.35f;
+	const float outputGain = wetGain * (left == right ? 0.25f : 0.5f);
+	float* memory = &delayMemory[0];
+	float taps[DPAR_REVERB_LINES];
+	float tailPeak = 0.0f;
+
+#ifdef DPAR_SSE2
+	const __m128 inputSigns0 = _mm_setr_ps(inputGain, -inputGain, inputGain, -inputGain);
+	const __m128 inputSigns1 = _mm_setr_ps(-inputGain, inputGain, -inputGain, inputGain);
+	const __m128 gain0 = _mm_loadu_ps(feedbackGain);
+	const __m128 gain1 = _mm_loadu_ps(feedbackGain + 4);
+	const __m128 dampCoefficient = _mm_set1_ps(damping);
+	const __m128 passCoefficient = _mm_set1_ps(1.0f - damping);
+	const __m128 householder = _mm_set1_ps(2.0f / DPAR_REVERB_LINES);
+	__m128 state0 = _mm_loadu_ps(dampState);
+	__m128 state1 = _mm_loadu_ps(dampState + 4);
+#endif
+
+	for (int i = 0; i < sampleCount; ++i) {
+		for (int l = 0; l < DPAR_REVERB_LINES; ++l) {
+			taps[l] = memory[l * maxLineLength + linePosition[l]];
+		}
+
+		const float input = sendBuffer[i];
+		float outLeft;
+		float outRight;
+
+#ifdef DPAR_SSE2
+		// Damping low pass on every line output
+		state0 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(taps), passCoefficient), _mm_mul_ps(state0, dampCoefficient));
+		state1 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(taps + 4), passCoefficient), _mm_mul_ps(state1, dampCoefficient));
+
+		// Householder feedback matrix: x - (2/N) * sum(x)
+		__m128 sum = _mm_add_ps(state0, state1);
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		sum = _mm_mul_ps(_mm_shuffle_ps(sum, sum, 0), householder);
+
+		const __m128 in = _mm_set1_ps(input);
+		_mm_storeu_ps(taps, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(state0, sum), gain0), _mm_mul_ps(in, inputSigns0)));
+		_mm_storeu_ps(taps + 4, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(state1, sum), gain1), _mm_mul_ps(in, inputSigns1)));
+
+		// Even lines feed the left output and odd lines the right
+		__m128 mixed = _mm_add_ps(state0, state1);
+		float lanes[4];
+		_mm_storeu_ps(lanes, mixed);
+		outLeft = lanes[0] + lanes[2];
+		outRight = lanes[1] + lanes[3];
+#else
+		float sum = 0.0f;
+		for (int l = 0; l < DPAR_REVERB_LINES; ++l) {
+			dampState[l] = taps[l] * (1.0f - damping) + dampState[l] * damping;
+			sum += dampState[l];
+		}
+		sum *= 2.0f / DPAR_REVERB_LINES;
+
+		outLeft = 0.0f;
+		outRight = 0.0f;
+		for (int l = 0; l < DPAR_REVERB_LINES; ++l) {
+			const float sign = ((l + l / 4) & 1) ? -1.0f : 1.0f;
+			taps[l] = (dampState[l] - sum) * feedbackGain[l] + input * inputGain * sign;
+			if (l & 1) {
+				outRight += dampState[l];
+			}
+			else {
+				outLeft += dampState[l];
+			}
+		}
+#endif
+
+		for (int l = 0; l < DPAR_REVERB_LINES; ++l) {
+			memory[l * maxLineLength + linePosition[l]] = taps[l];
+			if (++linePosition[l] == lineLength[l]) {
+				linePosition[l] = 0;
+			}
+		}
+
+		outLeft *= outputGain;
+		outRight *= outputGain;
+		const float framePeak = fabsf(outLeft) > fabsf(outRight) ? fabsf(outLeft) : fabsf(outRight);
+		if (framePeak > tailPeak) {
+			tailPeak = framePeak;
+		}
+
+		short* frame = samples + i * channels;
+		frame[left] = dpar_mixSaturate(frame[left], outLeft);
+		frame[right] = dpar_mixSaturate(frame[right], outRight);
+	}
+
+#ifdef DPAR_SSE2
+	_mm_storeu_ps(dampState, state0);
+	_mm_storeu_ps(dampState + 4, state1);
+#endif
+
+	const bool hadInput = sendLength > 0;
+	if (hadInput) {
+		memset(&sendBuffer[0], 0, sizeof(float) * sendLength);
+		sendLength = 0;
+	}
+
+	*channelFillMask |= (1u << left) | (1u << right);
+
+	if (!hadInput && tailPeak < 0.5f) {
+		// The tail is below one LSB, clear what is left in the lines and stop running the network
+		memset(memory, 0, sizeof(float) * delayMemory.size());
+		for (int l = 0; l < DPAR_REVERB_LINES; ++l) {
+			dampState[l] = 0.0f;
+		}
+		idle = true;
+	}
+}
@@ -0,0 +1,74 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Shared environment reverb: every talker feeds a mono send bus and a single feedback delay
+ * network runs once per frame on the mixed playback stream
+ */
+
+#ifndef DPAR_REVERB_H
+#define DPAR_REVERB_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+#include "dpar_audio.hpp"
+
+#define DPAR_REVERB_LINES 8
+
+enum DparEnvironment {
+	DPAR_ENV_NONE = 0,
+	DPAR_ENV_CAVE,
+	DPAR_ENV_FIELD,
+	DPAR_ENV_BUILDING,
+	DPAR_ENV_COUNT
+};
+
+// Maps the environment name sent by the reporting server ("cave", "field", "building") to its id
+DparEnvironment dpar_environmentFromName(const std::string& name);
+
+class ReverbBus {
+	std::atomic<int> requestedEnvironment;
+	int environment;
+
+	// All delay lines live in one block allocated at init, line i starts at i * maxLineLength
+	std::vector<float> delayMemory;
+	int maxLineLength;
+	int lineLength[DPAR_REVERB_LINES];
+	int linePosition[DPAR_REVERB_LINES];
+
+	float feedbackGain[DPAR_REVERB_LINES];
+	float damping;
+	float dampState[DPAR_REVERB_LINES];
+	float wetGain;
+
+	std::vector<float> sendBuffer;
+	int sendLength;
+
+	// Set once the tail has died away with nothing on the send bus, the network is skipped until a talker sends again
+	bool idle;
+
+	std::atomic<float> sendLevels[DPAR_MAX_CLIENTS];
+
+	void configure(int env);
+
+	public:
+		ReverbBus();
+
+		// Allocates the delay lines and send bus, call once before audio starts
+		void init(int maxFrameSamples);
+
+		void setEnvironment(DparEnvironment env);
+		bool enabled() const;
+
+		// Distance of the talker as a fraction of the cutoff, sets how much of the talker is sent to the reverb
+		void setSendDistance(anyID clientID, float normalizedDistance);
+
+		// Adds the talker's post processed audio into the send bus
+		void send(anyID clientID, const short* samples, int sampleCount, int channels, unsigned int channelFillMask);
+
+		// Runs the network over the send bus and mixes the result into the playback stream
+		void process(short* samples, int sampleCount, int channels, const unsigned int* channelSpeakerArray, unsigned int* channelFillMask);
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <exception>
+#include <vector>
+#include "dpar_scheduler.hpp"
+
+TickScheduler::TickScheduler() : stopping(false) {
+}
+
+void TickScheduler::start() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (thread.joinable()) {
+		return;
+	}
+
+	stopping = false;
+	thread = std::thread(&TickScheduler::run, this);
+}
+
+void TickScheduler::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		schedules.clear();
+	}
+	wake.notify_all();
+
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void TickScheduler::setInterval(uint64 id, std::chrono::milliseconds interval, std::function<void(uint64)> tick) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Schedule& schedule = schedules[id];
+		schedule.interval = interval;
+		schedule.next = std::chrono::steady_clock::now() + interval;
+		schedule.tick = std::move(tick);
+	}
+	wake.notify_all();
+}
+
+void TickScheduler::cancel(uint64 id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	schedules.erase(id);
+}
+
+void TickScheduler::run() {
+	std::vector<std::pair<uint64, std::function<void(uint64)>>> due;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping) {
+		if (schedules.empty()) {
+			wake.wait(lock);
+			continue;
+		}
+
+		std::chrono::steady_clock::time_point earliest = schedules.begin()->second.next;
+		for (std::map<uint64, Schedule>::iterator it = schedules.begin(); it != schedules.end(); ++it) {
+			if (it->second.next < earliest) {
+				earliest = it->second.next;
+			}
+		}
+
+		if (wake.wait_until(lock, earliest) != std::cv_status::timeout) {
+			// Woken to stop or because the schedules changed, work out the next tick again
+			continue;
+		}
+
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		due.clear();
+		for (std::map<uint64, Schedule>::iterator it = schedules.begin(); it != schedules.end(); ++it) {
+			Schedule& schedule = it->second;
+			if (schedule.next > now) {
+				continue;
+			}
+
+			// Skip ticks we slept through rather than firing them back to back
+			do {
+				schedule.next += schedule.interval;
+			} while (schedule.next <= now);
+			due.push_back(std::make_pair(it->first, schedule.tick));
+		}
+
+		// Ticks run unlocked so they can reschedule or cancel
+		lock.unlock();
+		for (size_t i = 0; i < due.size(); ++i) {
+			try {
+				due[i].second(due[i].first);
+			}
+			catch (const std::exception&) {
+				// A failed tick shouldn't end every other connection's schedule
+			}
+		}
+		lock.lock();
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Periodic ticks for every server connection, driven by one joinable thread. Ticks only
+ * hand work to the I/O executor so a late reporting server can't hold the others up.
+ */
+
+#ifndef DPAR_SCHEDULER_H
+#define DPAR_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "teamspeak/public_definitions.h"
+
+class TickScheduler {
+	struct Schedule {
+		std::chrono::milliseconds interval;
+		std::chrono::steady_clock::time_point next;
+		std::function<void(uint64)> tick;
+	};
+
+	std::map<uint64, Schedule> schedules;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	void run();
+
+	public:
+		TickScheduler();
+
+		void start();
+
+		// Wakes the thread and joins it, returns as soon as any tick already running has
+		void stop();
+
+		// Calls tick(id) every interval starting one interval from now, replacing any schedule id already had
+		void setInterval(uint64 id, std::chrono::milliseconds interval, std::function<void(uint64)> tick);
+
+		// Stops id's ticks, though one the thread has already picked up may still run
+		void cancel(uint64 id);
+};
+
+#endif
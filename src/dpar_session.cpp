@@ -0,0 +1,205 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include "dpar_session.hpp"
+
+ServerSession::ServerSession() : serverConnectionHandlerID(0), ticksOnTime(0), ticksLateDropped(0), ticksTimedOut(0), arena(DPAR_ARENA_INITIAL_BYTES) {
+	reset(0);
+}
+
+void ServerSession::init(int maxFrameSamples) {
+	spatializer.init(maxFrameSamples);
+	reverb.init(maxFrameSamples);
+}
+
+void ServerSession::reset(uint64 id) {
+	serverConnectionHandlerID = id;
+
+	rolloffOffset = 20.0f;
+	rolloffCutoff = 60.0f;
+	rolloffAttenuationCoefficient = 0.2f;
+	canHearUnregistered = true;
+	configVersion = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		reporting.targets.assign(1, ReportingTarget());
+		reporting.targets[0].uri = "http://wolfz.uk:9000";
+		reporting.targets[0].weight = 1;
+		channelEndpoints.clear();
+		serverUID.clear();
+		channelWork.cancel();
+		channelWork = pplx::cancellation_token_source();
+		connectionWork.cancel();
+		connectionWork = pplx::cancellation_token_source();
+	}
+	channelHasConfig = false;
+	positionRequestInFlight = false;
+	whisper.reset();
+	mutes.reset();
+	budget.clear();
+	audibility.reset();
+	players.clear();
+	refresh.reset();
+
+	ticksOnTime = 0;
+	ticksLateDropped = 0;
+	ticksTimedOut = 0;
+
+	gains.reset();
+	reverb.setEnvironment(DPAR_ENV_NONE);
+}
+
+SessionRef::SessionRef(SessionRef&& other) : table(other.table), session(other.session), parity(other.parity) {
+	other.table = NULL;
+	other.session = NULL;
+}
+
+SessionRef::~SessionRef() {
+	if (table != NULL) {
+		table->leaveReader(parity);
+	}
+}
+
+SessionTable::SessionTable(int maxFrameSamples) : maxFrameSamples(maxFrameSamples), epoch(0) {
+	for (int i = 0; i < DPAR_MAX_SESSIONS; ++i) {
+		ids[i].store(0, std::memory_order_relaxed);
+		sessions[i].store(NULL, std::memory_order_relaxed);
+	}
+	readers[0].store(0, std::memory_order_relaxed);
+	readers[1].store(0, std::memory_order_relaxed);
+}
+
+SessionTable::~SessionTable() {
+	for (int i = 0; i < DPAR_MAX_SESSIONS; ++i) {
+		delete sessions[i].load(std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < retired.size(); ++i) {
+		delete retired[i].session;
+	}
+}
+
+int SessionTable::enterReader() {
+	for (;;) {
+		const unsigned current = epoch.load();
+		readers[current & 1].fetch_add(1);
+
+		// Counted against an epoch that already moved on, reclaim may not have seen us so try again under the new one
+		if (epoch.load() == current) {
+			return (int)(current & 1);
+		}
+		readers[current & 1].fetch_sub(1);
+	}
+}
+
+void SessionTable::leaveReader(int parity) {
+	readers[parity].fetch_sub(1, std::memory_order_release);
+}
+
+void SessionTable::reclaim() {
+	// Up to the two steps a retired session needs, stopping at the first the readers hold up
+	for (int step = 0; step < 2 && !retired.empty(); ++step) {
+		const unsigned current = epoch.load();
+		if (readers[(current + 1) & 1].load(std::memory_order_acquire) != 0) {
+			break;
+		}
+		epoch.store(current + 1);
+	}
+
+	const unsigned current = epoch.load();
+	for (size_t i = 0; i < retired.size();) {
+		if (current - retired[i].epoch >= 2) {
+			delete retired[i].session;
+			retired[i] = retired.back();
+			retired.pop_back();
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+SessionRef SessionTable::find(uint64 id) {
+	if (id == 0) {
+		return SessionRef();
+	}
+
+	const int parity = enterReader();
+	for (int probe = 0; probe < DPAR_MAX_SESSIONS; ++probe) {
+		const int slot = (int)((id + probe) % DPAR_MAX_SESSIONS);
+		if (ids[slot].load() != id) {
+			continue;
+		}
+
+		// Checked again after loading, the slot may have been released and taken by another connection in between
+		ServerSession* session = sessions[slot].load();
+		if (session != NULL && ids[slot].load() == id) {
+			return SessionRef(this, session, parity);
+		}
+	}
+	leaveReader(parity);
+	return SessionRef();
+}
+
+SessionRef SessionTable::acquire(uint64 id) {
+	{
+		SessionRef found = find(id);
+		if (found != NULL || id == 0) {
+			return found;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	reclaim();
+
+	SessionRef session = find(id);
+	if (session != NULL) {
+		return session;
+	}
+
+	for (int probe = 0; probe < DPAR_MAX_SESSIONS; ++probe) {
+		const int slot = (int)((id + probe) % DPAR_MAX_SESSIONS);
+		if (ids[slot].load(std::memory_order_relaxed) != 0) {
+			continue;
+		}
+
+		// Never one a reader could still hold from the slot's last connection
+		ServerSession* fresh = new ServerSession();
+		fresh->init(maxFrameSamples);
+		fresh->reset(id);
+		sessions[slot].store(fresh);
+
+		// Publishing the id last means find never sees a session before it's ready
+		ids[slot].store(id);
+		return find(id);
+	}
+	return SessionRef();
+}
+
+void SessionTable::release(uint64 id) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int probe = 0; probe < DPAR_MAX_SESSIONS; ++probe) {
+		const int slot = (int)((id + probe) % DPAR_MAX_SESSIONS);
+		if (ids[slot].load(std::memory_order_relaxed) == id) {
+			ids[slot].store(0);
+
+			// Audio callbacks and requests in flight may have found it just before, so it's only retired here
+			RetiredSession old;
+			old.session = sessions[slot].exchange(NULL);
+			old.epoch = epoch.load();
+			retired.push_back(old);
+			break;
+		}
+	}
+	reclaim();
+}
+
+void SessionTable::forEach(const std::function<void(ServerSession&)>& visit) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int i = 0; i < DPAR_MAX_SESSIONS; ++i) {
+		if (ids[i].load(std::memory_order_relaxed) != 0) {
+			visit(*sessions[i].load(std::memory_order_relaxed));
+		}
+	}
+}
@@ -0,0 +1,187 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * State kept for each server connection (TeamSpeak tab): its channel's reporting server and
+ * config, the work in flight for it and the voice processing of its talkers. Sessions live
+ * in a fixed table the audio callbacks can search without locking.
+ */
+
+#ifndef DPAR_SESSION_H
+#define DPAR_SESSION_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "pplx/pplxtasks.h"
+#include "teamspeak/public_definitions.h"
+#include "dpar_arena.hpp"
+#include "dpar_audibility.hpp"
+#include "dpar_audio.hpp"
+#include "dpar_budget.hpp"
+#include "dpar_endpoint.hpp"
+#include "dpar_hrtf.hpp"
+#include "dpar_join.hpp"
+#include "dpar_reverb.hpp"
+#include "dpar_mute.hpp"
+#include "dpar_players.hpp"
+#include "dpar_refresh.hpp"
+#include "dpar_whisper.hpp"
+
+#define DPAR_MAX_SESSIONS 16
+
+/* Reporting servers a channel's description names, any of which can serve it */
+struct ChannelEndpoint {
+	std::vector<ReportingTarget> targets;
+};
+
+struct ServerSession {
+	uint64 serverConnectionHandlerID;
+
+	// Written by the I/O executor when a config arrives, read from the audio and tick threads
+	std::atomic<float> rolloffOffset;
+	std::atomic<float> rolloffCutoff;
+	std::atomic<float> rolloffAttenuationCoefficient;
+	std::atomic<bool> canHearUnregistered;
+
+	// Version of the config above as the server numbers them, 0 until a versioned one arrives
+	std::atomic<uint64_t> configVersion;
+
+	// Reporting servers named in the current channel's description, guarded by mutex
+	std::mutex mutex;
+	ChannelEndpoint reporting;
+	std::atomic<bool> channelHasConfig;
+
+	// Every channel on the server naming a reporting server, kept current by the channel events, guarded by mutex
+	std::map<uint64, ChannelEndpoint> channelEndpoints;
+
+	// Server's unique identifier, which the channel index is cached under, guarded by mutex
+	std::string serverUID;
+
+	// Cancelled whenever we leave a channel so nothing still in flight for it gets applied, guarded by mutex
+	pplx::cancellation_token_source channelWork;
+
+	// Cancelled on disconnect, covers background work such as config prefetches, guarded by mutex
+	pplx::cancellation_token_source connectionWork;
+
+	// Set while a position request is outstanding, ticks landing meanwhile are skipped rather than stacked up
+	std::atomic<bool> positionRequestInFlight;
+
+	// Outcome of every position request
+	std::atomic<uint64_t> ticksOnTime;
+	std::atomic<uint64_t> ticksLateDropped;
+	std::atomic<uint64_t> ticksTimedOut;
+
+	// Client IDs are only unique within a connection so each has its own voice processing
+	ClientGainTable gains;
+	Spatializer spatializer;
+	ReverbBus reverb;
+
+	// Clients our voice goes to while proximity whisper is on
+	WhisperList whisper;
+
+	// Talkers muted for being out of range while auto-mute is on
+	MuteManager mutes;
+
+	// Talkers faded out for going over the voice budget
+	TalkerBudget budget;
+
+	// Talkers silenced for being in a game channel we can't hear
+	AudibilityMask audibility;
+
+	// Held for the whole of applying a response and by anything else resetting the state below. Responses can
+	// finish on both I/O workers at once, and the next apply only sees players and playerIndex once this one is done.
+	// Clearing the whisper list and releasing mutes take it too, so an apply can't undo either afterwards
+	std::mutex applyMutex;
+
+	// Scratch for the talkers being placed, kept so its arrays are reused from tick to tick
+	PlayerStore players;
+
+	// Unique identifier to player record for the response being applied, rebuilt for each one
+	PlayerIndex playerIndex;
+
+	// Transient scratch for applying a response, reset at the start of each
+	TickArena arena;
+
+	// Which talkers' positions go to TeamSpeak each tick when the apply budget is on
+	RefreshScheduler refresh;
+
+	ServerSession();
+
+	// Allocates the voice processing, once before the session is first published
+	void init(int maxFrameSamples);
+
+	// Back to the defaults for the connection taking over this session
+	void reset(uint64 id);
+};
+
+class SessionTable;
+
+/* A session found in the table, kept allocated while this is held even if its connection is released meanwhile */
+class SessionRef {
+	SessionTable* table;
+	ServerSession* session;
+	int parity;
+
+	public:
+		SessionRef() : table(NULL), session(NULL), parity(0) {}
+		SessionRef(SessionTable* table, ServerSession* session, int parity) : table(table), session(session), parity(parity) {}
+		SessionRef(SessionRef&& other);
+		~SessionRef();
+
+		SessionRef(const SessionRef&) = delete;
+		SessionRef& operator=(const SessionRef&) = delete;
+
+		ServerSession* operator->() const { return session; }
+		ServerSession& operator*() const { return *session; }
+		bool operator==(std::nullptr_t) const { return session == NULL; }
+		bool operator!=(std::nullptr_t) const { return session != NULL; }
+};
+
+/* Session retired by release, deleted once every reader that could have found it is done */
+struct RetiredSession {
+	ServerSession* session;
+	unsigned epoch;
+};
+
+class SessionTable {
+	std::mutex mutex;
+	std::atomic<uint64> ids[DPAR_MAX_SESSIONS];               // 0 while the slot is free
+	std::atomic<ServerSession*> sessions[DPAR_MAX_SESSIONS];  // NULL while the slot is free, each connection gets a fresh session
+	int maxFrameSamples;
+
+	// Readers count themselves against the parity of the epoch they started in. The epoch only moves on once the
+	// other parity has drained, so two steps after a session is retired nothing can still be using it
+	std::atomic<unsigned> epoch;
+	std::atomic<int> readers[2];
+	std::vector<RetiredSession> retired;  // Guarded by mutex
+
+	int enterReader();
+	void leaveReader(int parity);
+
+	// Advances the epoch where readers allow and deletes what nobody can reach any more, with mutex held
+	void reclaim();
+
+	friend class SessionRef;
+
+	public:
+		explicit SessionTable(int maxFrameSamples);
+		~SessionTable();
+
+		// Lock free and allocation free for the audio callbacks, NULL if the connection has no session
+		SessionRef find(uint64 id);
+
+		// Finds or creates the connection's session, NULL only when every slot is taken
+		SessionRef acquire(uint64 id);
+
+		// Frees the connection's slot, its session can't be found afterwards and is deleted once no one holds it
+		void release(uint64 id);
+
+		void forEach(const std::function<void(ServerSession&)>& visit);
+};
+
+#endif
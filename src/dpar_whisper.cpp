@@ -0,0 +1,60 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include "dpar_whisper.hpp"
+
+WhisperList::WhisperList() : active(false) {
+}
+
+void WhisperList::begin() {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.clear();
+}
+
+void WhisperList::consider(anyID clientID, float distance, float cutoff) {
+	std::lock_guard<std::mutex> lock(mutex);
+	const float limit = cutoff * (targets.count(clientID) ? DPAR_WHISPER_LEAVE : DPAR_WHISPER_ENTER);
+	if (distance <= limit) {
+		pending.insert(clientID);
+	}
+}
+
+void WhisperList::include(anyID clientID) {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.insert(clientID);
+}
+
+bool WhisperList::commit(std::chrono::steady_clock::time_point now, std::vector<anyID>& send) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (active && pending == targets) {
+		return false;
+	}
+
+	// A change held back here is still pending next tick, worked out again against what the server has
+	if (active && now - lastSent < std::chrono::milliseconds(DPAR_WHISPER_MIN_INTERVAL_MS)) {
+		return false;
+	}
+
+	targets.swap(pending);
+	pending.clear();
+	active = true;
+	lastSent = now;
+
+	send.assign(targets.begin(), targets.end());
+	return true;
+}
+
+bool WhisperList::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+	const bool wasActive = active;
+	targets.clear();
+	pending.clear();
+	active = false;
+	return wasActive;
+}
+
+size_t WhisperList::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return targets.size();
+}
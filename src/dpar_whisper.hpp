@@ -0,0 +1,55 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Proximity whisper list. Instead of talking to the whole channel our voice is whispered to
+ * the clients close enough to hear it, so the server stops fanning it out to players who
+ * would only hear it at zero gain
+ */
+
+#ifndef DPAR_WHISPER_H
+#define DPAR_WHISPER_H
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+// Clients join the list within this multiple of the cutoff and only leave beyond the larger one,
+// so someone walking along the edge doesn't flap in and out
+#define DPAR_WHISPER_ENTER 1.1f
+#define DPAR_WHISPER_LEAVE 1.25f
+
+// Shortest gap between whisper list changes sent to the server
+#define DPAR_WHISPER_MIN_INTERVAL_MS 500
+
+class WhisperList {
+	std::mutex mutex;
+	std::set<anyID> targets;   // As last sent to the server
+	std::set<anyID> pending;   // Built up over the current tick
+	bool active;               // Whether the server has a list from us to clear
+	std::chrono::steady_clock::time_point lastSent;
+
+	public:
+		WhisperList();
+
+		// Starts building the list for a tick
+		void begin();
+
+		// Offers a client at a distance from us, whether it ends up on the list depends on whether it already was
+		void consider(anyID clientID, float distance, float cutoff);
+
+		// Puts a client on the list regardless of distance, for clients we can't place
+		void include(anyID clientID);
+
+		// Ends the tick, true with the clients to whisper to if the list changed and the rate limit allows sending it.
+		// An empty list means nobody is in range
+		bool commit(std::chrono::steady_clock::time_point now, std::vector<anyID>& send);
+
+		// Forgets the list, true if the server still has one from us that needs clearing
+		bool reset();
+
+		size_t size();
+};
+
+#endif
@@ -6,8 +6,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <iostream>
 #include <assert.h>
 #include <map>
+#include <set>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory_resource>
+#include <mutex>
 #include "cpprest/http_client.h"
 #include "cpprest/json.h"
 #include "cpprest/uri.h"
@@ -19,8 +26,17 @@
 #include "teamspeak/public_rare_definitions.h"
 #include "teamspeak/clientlib_publicdefinitions.h"
 #include "ts3_functions.h"
-#include "timercpp.h"
 #include "plugin.hpp"
+#include "dpar_audio.hpp"
+#include "dpar_hrtf.hpp"
+#include "dpar_reverb.hpp"
+#include "dpar_latency.hpp"
+#include "dpar_executor.hpp"
+#include "dpar_endpoint.hpp"
+#include "dpar_scheduler.hpp"
+#include "dpar_session.hpp"
+#include "dpar_cache.hpp"
+#include "dpar_clientlib.hpp"
 
 using namespace utility;                    // Common utilities like string conversions
 using namespace web;                        // Common features like URIs.
@@ -50,54 +66,544 @@ static struct TS3Functions ts3Functions;
 
 static char* pluginID = NULL;
 
-float RolloffOffset = 20.0f;
-float RolloffCutoff = 60.0f;
-float RolloffAttenuationCoefficient = 0.2f;
-bool CanHearUnregistered = true;
+// Ramp the rolloff volume across each voice frame instead of letting TeamSpeak step it on every position update
+bool GainSmoothing = true;
+
+// Render talkers binaurally with our own HRTF convolution instead of TeamSpeak's stereo panning. Toggled from the menu, read from the audio thread
+std::atomic<bool> SpatializerEnabled(false);
+
+// Whisper our voice to only the clients in hearing range instead of talking to the whole channel. Toggled from the menu, read by applies on the I/O workers
+std::atomic<bool> ProximityWhisper(false);
+
+// Mute talkers we couldn't hear anyway so the server stops sending us their voice. Off until turned on from the
+// "Toggle auto-mute" menu item, read by applies on the I/O workers
+std::atomic<bool> AutoMute(false);
+
+// Most talkers heard at once, the nearest win, 0 for no limit. Set with /dpar budget
+std::atomic<int> VoiceBudget(0);
+
+// Most talker positions pushed to TeamSpeak a tick, talkers in hearing range always go, 0 for no limit. Set with /dpar applybudget
+std::atomic<int> ApplyBudget(0);
 
 int UpdatesPerSecond = 15;
 
-std::string ServerHost = "wolfz.uk";
-std::string ServerPort = "9000";
+// Config, channel state and voice processing for each server connection, allowing for frames up to 100ms at 48kHz
+SessionTable Sessions(4800);
+
+// Position ticks for every connection, each tick only queues work on IoWork
+TickScheduler Ticks;
+
+// Runs every request to the reporting server, callbacks only queue work here
+#define DPAR_IO_QUEUE_CAPACITY 64
+#define DPAR_IO_WORKERS 2
+// How long unloading waits for cancelled requests to settle before dropping them
+#define DPAR_SHUTDOWN_DRAIN_MS 500
+IoExecutor IoWork(DPAR_IO_QUEUE_CAPACITY);
+
+// Continuations of those requests run on the same workers
+pplx::scheduler_ptr IoContinuations = std::make_shared<IoScheduler>(IoWork);
 
-bool ChannelHasConfig = false;
+// Position requests get a few ticks to answer, enough for a distant server, anything slower is too stale to apply.
+// Only one is out at a time so a slow server just thins out the updates
+#define DPAR_REQUEST_DEADLINE_TICKS 4
+#define DPAR_REQUEST_DEADLINE_MS (DPAR_REQUEST_DEADLINE_TICKS * 1000 / UpdatesPerSecond)
 
-Timer t;
+// What cpprest's WinHTTP client reports a timeout as, ERROR_WINHTTP_TIMEOUT
+#define DPAR_WINHTTP_TIMEOUT 12002
+
+// One set of clients and a circuit breaker per reporting server
+EndpointRegistry Endpoints(std::chrono::milliseconds(DPAR_REQUEST_DEADLINE_MS));
+
+// Configs and channel indexes from earlier runs, loaded at init and written back on disconnect and shutdown
+ConfigCache Cache;
+
+// Kinds of queued work, combined with the server connection to coalesce repeats
+enum {
+	DPAR_TASK_CONFIG = 1,
+	DPAR_TASK_POSITION,
+	DPAR_TASK_CHANNEL_JOIN,
+	DPAR_TASK_CACHE_SAVE
+};
 
 /********************************** DPAR plugin functions *********************************/
 #pragma region DPARFunctions
 
+pplx::task<void> dpar_requestPositionUpdate(uint64 serverConnectionHandlerID, pplx::cancellation_token token);
+void dpar_resetPositions(uint64 serverConnectionHandlerID);
+void dpar_clearWhisperList(uint64 serverConnectionHandlerID);
+void dpar_releaseMutes(uint64 serverConnectionHandlerID);
+
+uint64 dpar_taskKey(uint64 serverConnectionHandlerID, int kind) {
+	return (serverConnectionHandlerID << 4) | kind;
+}
+
+void dpar_tick(uint64 serverConnectionHandlerID) {
+	// If the previous update is still waiting to run there is no point queueing another
+	IoWork.postUnique(dpar_taskKey(serverConnectionHandlerID, DPAR_TASK_POSITION), [serverConnectionHandlerID]() {
+		dpar_update3Dposition(serverConnectionHandlerID);
+	});
+}
+
 void dpar_setIntervalForTimer(uint64 serverConnectionHandlerID) {
 	ts3Functions.logMessage("Restarting Timer (dpar_setIntervalForTimer)", LogLevel_DEBUG, "DPAR", serverConnectionHandlerID);
-	t.setInterval(&dpar_update3Dposition, serverConnectionHandlerID, 1000 / UpdatesPerSecond);
+	Ticks.setInterval(serverConnectionHandlerID, std::chrono::milliseconds(1000 / UpdatesPerSecond), &dpar_tick);
 }
 
-void dpar_updateFromRemoteConfiguration(uint64 serverConnectionHandlerID) {
-	ts3Functions.logMessage("Attempting to get attenuation config from remote", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+std::string dpar_endpointUri(const std::string& host, const std::string& port) {
+	return "http://" + host + ":" + port;
+}
+
+std::vector<ReportingTarget> dpar_reportingTargets(ServerSession& session) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	return session.reporting.targets;
+}
+
+bool dpar_sessionUsesEndpoint(ServerSession& session, const std::string& uri) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	for (size_t i = 0; i < session.reporting.targets.size(); ++i) {
+		if (session.reporting.targets[i].uri == uri) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Server the next request for the current channel goes to, NULL while none of them are usable
+std::shared_ptr<ReportingEndpoint> dpar_reportingEndpoint(ServerSession& session, const std::set<std::string>& exclude = std::set<std::string>()) {
+	return Endpoints.route(dpar_reportingTargets(session), exclude);
+}
 
-	std::string candidateUri = "http://" + std::string(ServerHost) + std::string(":") + std::string(ServerPort);
-	utility::string_t concatStr = utility::conversions::to_string_t(candidateUri);
-	web::http::client::http_client client(concatStr);
-	uri_builder builder(U("/config"));
+// True if the request gave up waiting rather than the server refusing or failing it
+bool dpar_isTimeout(const http_exception& e) {
+	return e.error_code() == std::errc::timed_out || e.error_code().value() == DPAR_WINHTTP_TIMEOUT;
+}
 
+// Unwraps a response, recording whether the endpoint answered against its breaker and how long it took
+json::value dpar_observeResponse(uint64 serverConnectionHandlerID, ReportingEndpoint& endpoint, pplx::task<json::value> response, std::chrono::steady_clock::time_point sent) {
 	try {
-		http_response response = client.request(methods::GET, builder.to_string()).get();
+		json::value result = response.get();
+		endpoint.recordRoundTrip(std::chrono::steady_clock::now() - sent);
+		if (endpoint.breaker.recordSuccess()) {
+			ts3Functions.logMessage("Reporting server reachable again", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+		}
+		return result;
+	}
+	catch (const pplx::task_canceled&) {
+		throw;
+	}
+	catch (const std::exception& e) {
+		// A missed deadline says the server is slow, not that it's down, so it doesn't count against the breaker
+		const http_exception* failure = dynamic_cast<const http_exception*>(&e);
+		const bool timedOut = failure != NULL && dpar_isTimeout(*failure);
+
+		if (!timedOut && endpoint.breaker.recordFailure()) {
+			ts3Functions.logMessage("Reporting server unreachable, backing off", LogLevel_WARNING, "DPAR", serverConnectionHandlerID);
+
+			// Once per outage rather than on every failed tick, and only once there's no other server to fail over to
+			SessionRef session = Sessions.find(serverConnectionHandlerID);
+			if (session != NULL && !Endpoints.anyHealthy(dpar_reportingTargets(*session))) {
+				dpar_resetPositions(serverConnectionHandlerID);
+			}
+		}
+		throw;
+	}
+}
+
+// Counts a request chain as outstanding on the executor until it settles, so unloading can wait for it
+template<typename T>
+pplx::task<T> dpar_trackAsync(pplx::task<T> chain) {
+	IoWork.beginAsync();
+	return chain.then([](pplx::task<T> settled) {
+		IoWork.endAsync();
+		return settled.get();
+	}, pplx::task_options(IoContinuations));
+}
+
+pplx::cancellation_token dpar_channelToken(ServerSession& session) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	return session.channelWork.get_token();
+}
+
+void dpar_cancelChannelWork(ServerSession& session) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	session.channelWork.cancel();
+	session.channelWork = pplx::cancellation_token_source();
+}
+
+pplx::cancellation_token dpar_connectionToken(ServerSession& session) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	return session.connectionWork.get_token();
+}
+
+// Cancels everything in flight for the connection, channel work included
+void dpar_cancelConnectionWork(ServerSession& session) {
+	dpar_cancelChannelWork(session);
+
+	std::lock_guard<std::mutex> lock(session.mutex);
+	session.connectionWork.cancel();
+	session.connectionWork = pplx::cancellation_token_source();
+}
+
+// Starts the timer unless the channel it was set up for has been left since
+void dpar_startTicking(uint64 serverConnectionHandlerID, pplx::cancellation_token token) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(session->mutex);
+	if (token.is_canceled()) {
+		return;
+	}
+	dpar_setIntervalForTimer(serverConnectionHandlerID);
+}
+
+// Fetches /config and remembers it on the endpoint, the returned task faults if the request or the parse fails
+pplx::task<RemoteConfig> dpar_fetchConfiguration(uint64 serverConnectionHandlerID, std::shared_ptr<ReportingEndpoint> endpoint, pplx::cancellation_token token) {
+	pplx::task_options options(token, IoContinuations);
+
+	// ETag of the response, filled in once it arrives
+	std::shared_ptr<utility::string_t> validator = std::make_shared<utility::string_t>();
+	const std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+
+	return dpar_trackAsync(pplx::create_task([serverConnectionHandlerID, endpoint, token]() {
+		ts3Functions.logMessage("Attempting to get attenuation config from remote", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+
+		uri_builder builder(U("/config"));
+		http_request request(methods::GET);
+		request.set_request_uri(builder.to_string());
+
+		// A config we already hold, from this run or the cache, only needs revalidating
+		const std::string known = endpoint->configValidator();
+		if (!known.empty()) {
+			request.headers().add(header_names::if_none_match, conversions::to_string_t(known));
+		}
+		return endpoint->client.request(request, token);
+	}, options).then([validator](http_response response) {
+		if (response.status_code() == status_codes::NotModified) {
+			// No body, what we hold is still current
+			return pplx::task_from_result(json::value());
+		}
+		response.headers().match(header_names::etag, *validator);
+		return response.extract_json();
+	}, options).then([serverConnectionHandlerID, endpoint, sent](pplx::task<json::value> response) {
+		return dpar_observeResponse(serverConnectionHandlerID, *endpoint, response, sent);
+	}, pplx::task_options(IoContinuations)).then([endpoint, validator](json::value response) {
+		RemoteConfig config;
+		if (response.is_null()) {
+			if (!endpoint->loadConfig(config)) {
+				throw std::runtime_error("Config not modified but none held");
+			}
+			endpoint->storeConfig(config, endpoint->configValidator());
+			return config;
+		}
 
 		//Parse network response
-		json::object jsonVal = response.extract_json().get().as_object();
+		json::object jsonVal = response.as_object();
+
+		config.cutoff = (float)jsonVal[L"cutoffDistance"].as_double();
+		config.attenuationCoefficient = (float)(1 / jsonVal[L"attenuationCoefficient"].as_double());
+		config.offset = (float)jsonVal[L"safeZoneSize"].as_double();
+		config.canHearUnregistered = jsonVal[L"unregisteredCanBroadcast"].as_bool();
+		config.version = jsonVal.find(L"configVersion") != jsonVal.end() ? (uint64_t)jsonVal[L"configVersion"].as_number_int64() : 0;
+
+		// Only stored once the whole response parsed so a bad payload can't leave a half applied config
+		const std::string etag = conversions::to_utf8string(*validator);
+		endpoint->storeConfig(config, etag);
+		Cache.storeConfig(endpoint->uri, config, etag);
+		return config;
+	}, options));
+}
+
+void dpar_publishConfiguration(ServerSession& session, const RemoteConfig& config) {
+	session.rolloffCutoff = config.cutoff;
+	session.rolloffAttenuationCoefficient = config.attenuationCoefficient;
+	session.rolloffOffset = config.offset;
+	session.canHearUnregistered = config.canHearUnregistered;
+	session.configVersion = config.version;
+}
+
+RemoteConfig dpar_currentConfiguration(ServerSession& session) {
+	RemoteConfig config;
+	config.cutoff = session.rolloffCutoff;
+	config.attenuationCoefficient = session.rolloffAttenuationCoefficient;
+	config.offset = session.rolloffOffset;
+	config.canHearUnregistered = session.canHearUnregistered;
+	config.version = session.configVersion;
+	return config;
+}
+
+// Applies a config carried in a position response ahead of the positions it came with.
+// The server may send all of it or only what changed, anything absent keeps its current value
+bool dpar_applyInlineConfiguration(ServerSession& session, const std::string& uri, json::object& delta) {
+	RemoteConfig config = dpar_currentConfiguration(session);
+
+	const bool versioned = delta.find(L"configVersion") != delta.end();
+	if (versioned) {
+		const uint64_t version = (uint64_t)delta[L"configVersion"].as_number_int64();
+		if (version <= config.version) {
+			// Already have it, or it's older than what a /config fetch brought in meanwhile
+			return false;
+		}
+		config.version = version;
+	}
+
+	if (delta.find(L"cutoffDistance") != delta.end()) {
+		config.cutoff = (float)delta[L"cutoffDistance"].as_double();
+	}
+	if (delta.find(L"attenuationCoefficient") != delta.end()) {
+		config.attenuationCoefficient = (float)(1 / delta[L"attenuationCoefficient"].as_double());
+	}
+	if (delta.find(L"safeZoneSize") != delta.end()) {
+		config.offset = (float)delta[L"safeZoneSize"].as_double();
+	}
+	if (delta.find(L"unregisteredCanBroadcast") != delta.end()) {
+		config.canHearUnregistered = delta[L"unregisteredCanBroadcast"].as_bool();
+	}
+
+	dpar_publishConfiguration(session, config);
+
+	// No ETag describes a merged config, the next /config fetches it whole
+	try {
+		Endpoints.get(uri)->storeConfig(config, std::string());
+	}
+	catch (const std::exception& e) {
+		// The uri came from an endpoint that already exists, so this can't happen
+	}
+	Cache.storeConfig(uri, config, std::string());
+	return true;
+}
+
+void dpar_queuePrefetch(uint64 serverConnectionHandlerID, const std::string& uri);
+
+// Publishes the config last fetched from any of the session's reporting servers, false if there isn't one yet
+bool dpar_applyKnownConfiguration(ServerSession& session) {
+	std::vector<ReportingTarget> targets = dpar_reportingTargets(session);
+	std::shared_ptr<ReportingEndpoint> endpoint;
+	RemoteConfig config;
+	for (size_t i = 0; i < targets.size() && !endpoint; ++i) {
+		try {
+			endpoint = Endpoints.get(targets[i].uri);
+		}
+		catch (const std::exception& e) {
+			continue;
+		}
+		if (!endpoint->loadConfig(config)) {
+			endpoint.reset();
+		}
+	}
+	if (!endpoint) {
+		return false;
+	}
+
+	dpar_publishConfiguration(session, config);
+	ts3Functions.logMessage("Applied prefetched attenuation config", LogLevel_INFO, "DPAR", session.serverConnectionHandlerID);
 
-		RolloffCutoff = jsonVal[L"cutoffDistance"].as_double();
-		RolloffAttenuationCoefficient = 1 / jsonVal[L"attenuationCoefficient"].as_double();
-		RolloffOffset = jsonVal[L"safeZoneSize"].as_double();
-		CanHearUnregistered = jsonVal[L"unregisteredCanBroadcast"].as_bool();
+	if (!endpoint->isConfigFresh()) {
+		// Remembered from an earlier run, good enough to start with while it's revalidated
+		dpar_queuePrefetch(session.serverConnectionHandlerID, endpoint->uri);
+	}
+	return true;
+}
+
+// Fetches /config and publishes it, the returned task faults if the request or the parse fails
+pplx::task<void> dpar_requestRemoteConfiguration(uint64 serverConnectionHandlerID, pplx::cancellation_token token) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return pplx::task_from_result();
+	}
+
+	std::shared_ptr<ReportingEndpoint> endpoint = dpar_reportingEndpoint(*session);
+	if (!endpoint) {
+		// Keep the config we have until a breaker lets a probe through
+		return pplx::task_from_result();
+	}
+
+	return dpar_fetchConfiguration(serverConnectionHandlerID, endpoint, token).then([serverConnectionHandlerID](RemoteConfig config) {
+		SessionRef session = Sessions.find(serverConnectionHandlerID);
+		if (session == NULL) {
+			return;
+		}
+		dpar_publishConfiguration(*session, config);
 
 		ts3Functions.logMessage("Successfully updated attenuation config from remote", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+	}, pplx::task_options(token, IoContinuations));
+}
+
+// Fetches (or revalidates) the config of a reporting server ahead of joining a channel using it, unless it's fresh or on its way
+void dpar_prefetchConfiguration(uint64 serverConnectionHandlerID, const std::string& uri) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	std::shared_ptr<ReportingEndpoint> endpoint;
+	try {
+		endpoint = Endpoints.get(uri);
+	}
+	catch (const std::exception& e) {
+		// Logged when the channel is joined
+		return;
+	}
+
+	if (endpoint->isConfigFresh() || endpoint->prefetching.exchange(true)) {
+		return;
+	}
+	if (!endpoint->breaker.allowRequest()) {
+		endpoint->prefetching = false;
+		return;
+	}
+
+	dpar_fetchConfiguration(serverConnectionHandlerID, endpoint, dpar_connectionToken(*session)).then([serverConnectionHandlerID, endpoint](pplx::task<RemoteConfig> fetched) {
+		endpoint->prefetching = false;
+		try {
+			RemoteConfig config = fetched.get();
+
+			// A revalidation can land after we joined a channel on this server with the cached copy
+			SessionRef session = Sessions.find(serverConnectionHandlerID);
+			if (session != NULL && session->channelHasConfig && dpar_sessionUsesEndpoint(*session, endpoint->uri)) {
+				dpar_publishConfiguration(*session, config);
+			}
+		}
+		catch (const std::exception& e) {
+			// Not worth a log line, joining a channel on this server fetches it again and reports any failure
+		}
+	}, pplx::task_options(IoContinuations));
+}
+
+void dpar_queuePrefetch(uint64 serverConnectionHandlerID, const std::string& uri) {
+	if (!IoWork.post([serverConnectionHandlerID, uri]() { dpar_prefetchConfiguration(serverConnectionHandlerID, uri); })) {
+		ts3Functions.logMessage("I/O queue full, dropped config prefetch", LogLevel_DEBUG, "DPAR", serverConnectionHandlerID);
+	}
+}
+
+// Prefetches every server a channel names, which also gives each a first RTT to route by
+void dpar_prefetchChannel(uint64 serverConnectionHandlerID, const ChannelEndpoint& channel) {
+	for (size_t i = 0; i < channel.targets.size(); ++i) {
+		dpar_queuePrefetch(serverConnectionHandlerID, channel.targets[i].uri);
+	}
+}
+
+void dpar_queueCacheSave() {
+	IoWork.postUnique(dpar_taskKey(0, DPAR_TASK_CACHE_SAVE), []() {
+		if (!Cache.save()) {
+			ts3Functions.logMessage("Failed to write config cache", LogLevel_WARNING, "DPAR", 0);
+		}
+	});
+}
+
+// Records a connection's channel index under its server's identifier, ready for the next connect
+void dpar_persistChannelIndex(ServerSession& session) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	Cache.storeChannels(session.serverUID, session.channelEndpoints);
+}
+
+// Starts a connection from the channel index cached for its server, prefetching each reporting server it names
+void dpar_restoreChannelIndex(uint64 serverConnectionHandlerID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	ClientlibString serverUID(DPAR_CLIENTLIB_SITE("restoreChannelIndex server UID"));
+	if (ts3Functions.getServerVariableAsString(serverConnectionHandlerID, VIRTUALSERVER_UNIQUE_IDENTIFIER, serverUID.out()) != ERROR_ok || serverUID.get() == NULL) {
+		return;
+	}
+	std::string uid(serverUID.get());
+
+	std::map<uint64, ChannelEndpoint> index;
+	const bool cached = Cache.loadChannels(uid, index);
+	{
+		std::lock_guard<std::mutex> lock(session->mutex);
+		session->serverUID = uid;
+		if (cached) {
+			session->channelEndpoints = index;
+		}
+	}
+	if (!cached) {
+		return;
+	}
+
+	std::set<std::string> uris;
+	for (std::map<uint64, ChannelEndpoint>::const_iterator it = index.begin(); it != index.end(); ++it) {
+		for (size_t i = 0; i < it->second.targets.size(); ++i) {
+			uris.insert(it->second.targets[i].uri);
+		}
+	}
+	for (std::set<std::string>::const_iterator it = uris.begin(); it != uris.end(); ++it) {
+		dpar_queuePrefetch(serverConnectionHandlerID, *it);
+	}
+}
+
+// Observes a config request so its failure is logged rather than left unobserved
+void dpar_reportRemoteConfiguration(uint64 serverConnectionHandlerID, pplx::task<void> config) {
+	try {
+		config.get();
+	}
+	catch (const pplx::task_canceled&) {
+		// Left the channel before it arrived
 	}
 	catch (const std::exception& e) {
 		ts3Functions.logMessage("Failed to load attenuation config from remote", LogLevel_ERROR, "DPAR", serverConnectionHandlerID);
 	}
 }
 
+void dpar_updateFromRemoteConfiguration(uint64 serverConnectionHandlerID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	dpar_requestRemoteConfiguration(serverConnectionHandlerID, dpar_channelToken(*session)).then([serverConnectionHandlerID](pplx::task<void> config) {
+		dpar_reportRemoteConfiguration(serverConnectionHandlerID, config);
+	}, pplx::task_options(IoContinuations));
+}
+
+void dpar_queueConfigRefresh(uint64 serverConnectionHandlerID) {
+	bool queued = IoWork.postUnique(dpar_taskKey(serverConnectionHandlerID, DPAR_TASK_CONFIG), [serverConnectionHandlerID]() {
+		dpar_updateFromRemoteConfiguration(serverConnectionHandlerID);
+	});
+	if (!queued) {
+		ts3Functions.logMessage("I/O queue full, dropped config refresh", LogLevel_WARNING, "DPAR", serverConnectionHandlerID);
+	}
+}
+
+// Config (unless already prefetched), then the first position update, then the timer, each step dropped once we leave the channel
+void dpar_startChannelPipeline(uint64 serverConnectionHandlerID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	pplx::cancellation_token token = dpar_channelToken(*session);
+
+	// With the config prefetched the first position update goes out straight away
+	pplx::task<void> config = dpar_applyKnownConfiguration(*session) ? pplx::task_from_result() : dpar_requestRemoteConfiguration(serverConnectionHandlerID, token);
+
+	config.then([serverConnectionHandlerID, token](pplx::task<void> config) {
+		// A failed config isn't fatal, positions still work with whatever config we already had
+		dpar_reportRemoteConfiguration(serverConnectionHandlerID, config);
+		if (token.is_canceled()) {
+			return pplx::task_from_result();
+		}
+
+		// Update the 3D positions of clients instantly
+		return dpar_requestPositionUpdate(serverConnectionHandlerID, token);
+	}, pplx::task_options(IoContinuations)).then([serverConnectionHandlerID, token]() {
+		// Schedule updates on an interval as soon as the first one is in
+		dpar_startTicking(serverConnectionHandlerID, token);
+	}, pplx::task_options(IoContinuations));
+}
+
+void dpar_queueChannelJoin(uint64 serverConnectionHandlerID) {
+	bool queued = IoWork.postUnique(dpar_taskKey(serverConnectionHandlerID, DPAR_TASK_CHANNEL_JOIN), [serverConnectionHandlerID]() {
+		dpar_startChannelPipeline(serverConnectionHandlerID);
+	});
+	if (!queued) {
+		ts3Functions.logMessage("I/O queue full, dropped channel join", LogLevel_WARNING, "DPAR", serverConnectionHandlerID);
+	}
+}
+
 anyID dpar_getMyClientID(uint64 serverConnectionHandlerID) {
 	anyID id = NULL;
 	ts3Functions.getClientID(serverConnectionHandlerID, &id);
@@ -125,13 +631,13 @@ string dpar_getMyClientUID(uint64 serverConnectionHandlerID) {
 
 	anyID id = dpar_getMyClientID(serverConnectionHandlerID);
 
-	char* meclientUID = NULL;
-	ts3Functions.getClientVariableAsString(serverConnectionHandlerID, id, CLIENT_UNIQUE_IDENTIFIER, &meclientUID);
-	if (meclientUID == NULL) {
+	ClientlibString meclientUID(DPAR_CLIENTLIB_SITE("getMyClientUID"));
+	ts3Functions.getClientVariableAsString(serverConnectionHandlerID, id, CLIENT_UNIQUE_IDENTIFIER, meclientUID.out());
+	if (meclientUID.get() == NULL) {
 		ts3Functions.logMessage("Failed to get own identity ID", LogLevel_ERROR, "DPAR", serverConnectionHandlerID);
 		return "";
 	}
-	std::string meclientUIDstr(meclientUID);
+	std::string meclientUIDstr(meclientUID.get());
 	return meclientUIDstr;
 }
 
@@ -145,94 +651,366 @@ void dpar_clientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint
 
 	printf("ts3plugin_onClientMoveEvent IDs: %d %d\n", myID, clientID);
 
-	cout << &t << endl;
-
 	if (myID == clientID) {
-		// We moved channel so should stop updating positions until we can establish the channel's config
-		t.stop();
+		SessionRef session = Sessions.acquire(serverConnectionHandlerID);
+		if (session == NULL) {
+			ts3Functions.logMessage("Too many server connections, positional audio disabled for this one", LogLevel_WARNING, "DPAR", serverConnectionHandlerID);
+			return;
+		}
+
+		// We moved channel so should stop updating positions until we can establish the channel's config,
+		// anything still in flight for the old channel is cancelled rather than applied
+		dpar_cancelChannelWork(*session);
+		Ticks.cancel(serverConnectionHandlerID);
 		printf("DPAR: Kill timer\n");
+		dpar_clearWhisperList(serverConnectionHandlerID);
+		dpar_releaseMutes(serverConnectionHandlerID);
+		session->budget.reset();
+		session->gains.reset();
+		session->reverb.setEnvironment(DPAR_ENV_NONE);
 		dpar_updateConfigFromChannelDescription(serverConnectionHandlerID, newChannelID);
 
-		if (ChannelHasConfig) {
-			// Attempt to get new parameters from the remote
-			dpar_updateFromRemoteConfiguration(serverConnectionHandlerID);
+		if (session->channelHasConfig) {
+			// Config fetch, first update and timer start are chained on the I/O executor
+			dpar_queueChannelJoin(serverConnectionHandlerID);
+		}
+	}
+}
+
+void dpar_updateCurrentReportingServerConfig(ServerSession& session, const ChannelEndpoint& channel) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	session.reporting = channel;
+}
+
+// What a channel description holds. "|host|port|" or "|host|" name a reporting server, the host part may also list
+// several as "host[:port][*weight]" separated by commas, e.g. "|a.example*2,b.example:9001|", any without a port of
+// their own using the one after it
+enum DparDescription {
+	DPAR_DESCRIPTION_MISSING = 0,  // Not sent to us yet, or empty
+	DPAR_DESCRIPTION_NONE,
+	DPAR_DESCRIPTION_SINGLE_BAR,
+	DPAR_DESCRIPTION_HOST,
+	DPAR_DESCRIPTION_HOST_AND_PORT
+};
+
+DparDescription dpar_parseChannelDescription(const std::string& channelDescStr, ChannelEndpoint& channel) {
+	if (channelDescStr.empty()) {
+		return DPAR_DESCRIPTION_MISSING;
+	}
+
+	int startPos = channelDescStr.find_first_of("|");
+	if (startPos == -1l) {
+		return DPAR_DESCRIPTION_NONE;
+	}
+
+	int midPos = channelDescStr.find_first_of("|", startPos + 1);
+	if (midPos == -1l) {
+		return DPAR_DESCRIPTION_SINGLE_BAR;
+	}
+
+	std::string hosts = channelDescStr.substr(startPos + 1, midPos - (startPos + 1));
 
-			// Update the 3D positions of clients instantly
-			dpar_update3Dposition(serverConnectionHandlerID);
+	DparDescription description = DPAR_DESCRIPTION_HOST;
+	std::string defaultPort = "9000";
+
+	int endPos = channelDescStr.find_first_of("|", midPos + 1);
+	if (endPos != -1l) {
+		defaultPort = channelDescStr.substr(midPos + 1, endPos - (midPos + 1));
+		description = DPAR_DESCRIPTION_HOST_AND_PORT;
+	}
+
+	channel.targets.clear();
+	size_t begin = 0;
+	while (begin <= hosts.size()) {
+		size_t end = hosts.find(',', begin);
+		if (end == std::string::npos) {
+			end = hosts.size();
+		}
+		std::string entry = hosts.substr(begin, end - begin);
+		begin = end + 1;
+
+		ReportingTarget target;
+		target.weight = 1;
+		size_t weightPos = entry.find('*');
+		if (weightPos != std::string::npos) {
+			target.weight = std::max(1, atoi(entry.c_str() + weightPos + 1));
+			entry.erase(weightPos);
+		}
 
-			// Schedule updates on an interval
-			t.setTimeout(&dpar_setIntervalForTimer, serverConnectionHandlerID, 500);
+		size_t portPos = entry.find(':');
+		std::string host = entry.substr(0, portPos);
+		std::string port = portPos == std::string::npos ? defaultPort : entry.substr(portPos + 1);
+		if (host.empty()) {
+			continue;
 		}
+		target.uri = dpar_endpointUri(host, port);
+		channel.targets.push_back(target);
 	}
-}
 
-void dpar_updateCurrentReportingServerConfig(std::string serverAddress, std::string serverPort) {
-	ServerHost = serverAddress;
-	ServerPort = serverPort;
+	return channel.targets.empty() ? DPAR_DESCRIPTION_NONE : description;
 }
 
-void dpar_updateConfigFromChannelDescription(uint64 serverConnectionHandlerID, uint64 channelID) {
+// Reads a channel's description into the session's channel index, a missing description leaves what was indexed alone
+DparDescription dpar_indexChannel(ServerSession& session, uint64 channelID, ChannelEndpoint& channel) {
+	ClientlibString channelDesc(DPAR_CLIENTLIB_SITE("indexChannel description"));
+	if (ts3Functions.getChannelVariableAsString(session.serverConnectionHandlerID, channelID, CHANNEL_DESCRIPTION, channelDesc.out()) != ERROR_ok || channelDesc.get() == NULL) {
+		return DPAR_DESCRIPTION_MISSING;
+	}
+	std::string channelDescStr(channelDesc.get());
+	channelDesc.reset();
 
-	ts3Functions.logMessage("Attempting to get remote host's config from channel", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+	DparDescription description = dpar_parseChannelDescription(channelDescStr, channel);
+	if (description == DPAR_DESCRIPTION_MISSING) {
+		return description;
+	}
 
-	char* channelDesc;
-	ts3Functions.getChannelVariableAsString(serverConnectionHandlerID, channelID, CHANNEL_DESCRIPTION, &channelDesc);
+	std::lock_guard<std::mutex> lock(session.mutex);
+	if (description == DPAR_DESCRIPTION_HOST || description == DPAR_DESCRIPTION_HOST_AND_PORT) {
+		session.channelEndpoints[channelID] = channel;
+	}
+	else {
+		session.channelEndpoints.erase(channelID);
+	}
+	return description;
+}
 
-	std::string channelDescStr(channelDesc);
+// Reporting server the index has for a channel, false if it names none
+bool dpar_lookupChannel(ServerSession& session, uint64 channelID, ChannelEndpoint& channel) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	std::map<uint64, ChannelEndpoint>::iterator it = session.channelEndpoints.find(channelID);
+	if (it == session.channelEndpoints.end()) {
+		return false;
+	}
+	channel = it->second;
+	return true;
+}
 
-	int startPos = channelDescStr.find_first_of("|");
-	if (!(startPos == -1l)) {
-		int midPos = channelDescStr.find_first_of("|", startPos + 1);
+// Indexes a channel we aren't in and prefetches its reporting server's config, asking for the description if we don't have it
+void dpar_indexOtherChannel(uint64 serverConnectionHandlerID, uint64 channelID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
 
-		if (!(midPos == -1l)) {
-			std::string serverAddress = channelDescStr.substr(startPos + 1, midPos - (startPos + 1));
+	ChannelEndpoint channel;
+	switch (dpar_indexChannel(*session, channelID, channel)) {
+		case DPAR_DESCRIPTION_MISSING:
+			// TeamSpeak only sends descriptions on request, onChannelDescriptionUpdateEvent indexes it once it arrives
+			ts3Functions.requestChannelDescription(serverConnectionHandlerID, channelID, NULL);
+			break;
+		case DPAR_DESCRIPTION_HOST:
+		case DPAR_DESCRIPTION_HOST_AND_PORT:
+			dpar_prefetchChannel(serverConnectionHandlerID, channel);
+			break;
+		default:
+			break;
+	}
+}
+
+void dpar_forgetChannel(uint64 serverConnectionHandlerID, uint64 channelID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
 
-			int endPos = channelDescStr.find_first_of("|", midPos + 1);
+	std::lock_guard<std::mutex> lock(session->mutex);
+	session->channelEndpoints.erase(channelID);
+}
 
-			if (!(endPos == -1l)) {
-				ts3Functions.logMessage("Host and port config found", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+void dpar_updateConfigFromChannelDescription(uint64 serverConnectionHandlerID, uint64 channelID) {
+	SessionRef session = Sessions.acquire(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
 
-				std::string serverPort = channelDescStr.substr(midPos + 1, endPos - (midPos + 1));
+	ts3Functions.logMessage("Attempting to get remote host's config from channel", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
 
-				printf("PLUGIN: Server Setting: %s %s\n", serverAddress, serverPort);
-				dpar_updateCurrentReportingServerConfig(serverAddress, serverPort);
-				ChannelHasConfig = true;
+	ChannelEndpoint channel;
+	switch (dpar_indexChannel(*session, channelID, channel)) {
+		case DPAR_DESCRIPTION_HOST_AND_PORT:
+			ts3Functions.logMessage("Host and port config found", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+			break;
+		case DPAR_DESCRIPTION_HOST:
+			ts3Functions.logMessage("Host only config found", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+			break;
+		case DPAR_DESCRIPTION_SINGLE_BAR:
+			ts3Functions.logMessage("No valid config found (Single '|')", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+			session->channelHasConfig = false;
+			return;
+		case DPAR_DESCRIPTION_MISSING:
+			// The client can drop a description it fetched earlier, the index still has what it said
+			if (dpar_lookupChannel(*session, channelID, channel)) {
+				ts3Functions.logMessage("Config found in channel index", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+				break;
 			}
-			else {
-				ts3Functions.logMessage("Host only config found", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+			ts3Functions.logMessage("No valid config found", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+			session->channelHasConfig = false;
+			return;
+		default:
+			ts3Functions.logMessage("No valid config found", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+			session->channelHasConfig = false;
+			return;
+	}
 
-				std::string serverPort = "9000";
+	for (size_t i = 0; i < channel.targets.size(); ++i) {
+		printf("PLUGIN: Server Setting: %s weight %d\n", channel.targets[i].uri.c_str(), channel.targets[i].weight);
+		try {
+			Endpoints.get(channel.targets[i].uri);
+		}
+		catch (const std::exception& e) {
+			ts3Functions.logMessage("Invalid reporting server address", LogLevel_ERROR, "DPAR", serverConnectionHandlerID);
+		}
+	}
+	dpar_updateCurrentReportingServerConfig(*session, channel);
+	session->channelHasConfig = true;
+}
 
-				printf("PLUGIN: Server Setting: %s %s\n", serverAddress, serverPort);
-				dpar_updateCurrentReportingServerConfig(serverAddress, serverPort);
-				ChannelHasConfig = true;
-			}
+// Back to talking to the whole channel. Holds off any apply so one already running can't send its list after ours
+void dpar_clearWhisperList(uint64 serverConnectionHandlerID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> applying(session->applyMutex);
+	if (session->whisper.reset()) {
+		ts3Functions.requestClientSetWhisperList(serverConnectionHandlerID, 0, NULL, NULL, NULL);
+	}
+}
+
+// Sends the whisper list built up while applying positions, if it changed and the rate limit allows
+void dpar_sendWhisperList(uint64 serverConnectionHandlerID, ServerSession& session) {
+	std::vector<anyID> targets;
+	if (!session.whisper.commit(std::chrono::steady_clock::now(), targets)) {
+		return;
+	}
+
+	// An empty list would clear whispering and talk to the whole channel, so nobody in range is whispering to ourselves
+	if (targets.empty()) {
+		targets.push_back(dpar_getMyClientID(serverConnectionHandlerID));
+	}
+	targets.push_back(0);
+
+	if (ts3Functions.requestClientSetWhisperList(serverConnectionHandlerID, 0, NULL, &targets[0], NULL) != ERROR_ok) {
+		ts3Functions.logMessage("Failed to set proximity whisper list", LogLevel_WARNING, "DPAR", serverConnectionHandlerID);
+	}
+}
+
+// Mutes and unmutes talkers in two batches, temporary mutes so none of ours end up saved against the client
+void dpar_sendMutes(uint64 serverConnectionHandlerID, std::pmr::vector<anyID>& mute, std::pmr::vector<anyID>& unmute) {
+	if (!mute.empty()) {
+		mute.push_back(0);
+		if (ts3Functions.requestMuteClientsTemporary(serverConnectionHandlerID, &mute[0], NULL) != ERROR_ok) {
+			ts3Functions.logMessage("Failed to mute out of range talkers", LogLevel_WARNING, "DPAR", serverConnectionHandlerID);
 		}
-		else {
-			ts3Functions.logMessage("No valid config found (Single '|')", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
-			ChannelHasConfig = false;
+	}
+	if (!unmute.empty()) {
+		unmute.push_back(0);
+		if (ts3Functions.requestUnmuteClientsTemporary(serverConnectionHandlerID, &unmute[0], NULL) != ERROR_ok) {
+			ts3Functions.logMessage("Failed to unmute talkers back in range", LogLevel_WARNING, "DPAR", serverConnectionHandlerID);
 		}
 	}
-	else {
-		ts3Functions.logMessage("No valid config found", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
-		ChannelHasConfig = false;
+}
+
+// Unmutes every talker we muted, the user's own mutes stay as they are. Holds off any apply so one already
+// running can't mute them again after we've let them go
+void dpar_releaseMutes(uint64 serverConnectionHandlerID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
 	}
+
+	std::lock_guard<std::mutex> applying(session->applyMutex);
+	const std::vector<anyID> ours = session->mutes.reset();
+	std::pmr::vector<anyID> mute;
+	std::pmr::vector<anyID> unmute(ours.begin(), ours.end());
+	dpar_sendMutes(serverConnectionHandlerID, mute, unmute);
 }
 
-void dpar_update3Dposition(uint64 serverConnectionHandlerID) {
+bool dpar_isClientMuted(uint64 serverConnectionHandlerID, anyID clientID) {
+	int muted = 0;
+	return ts3Functions.getClientVariableAsInt(serverConnectionHandlerID, clientID, CLIENT_IS_MUTED, &muted) == ERROR_ok && muted != 0;
+}
+
+//The following resets the clients positions - this is needed for when positional audio is not being used
+void dpar_resetPositions(uint64 serverConnectionHandlerID) {
+	// Without positions there's no telling who is in range
+	dpar_clearWhisperList(serverConnectionHandlerID);
+	dpar_releaseMutes(serverConnectionHandlerID);
+
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session != NULL) {
+		session->budget.reset();
+
+		// Both are otherwise only touched by an apply, which may be running on the other I/O worker
+		std::lock_guard<std::mutex> applying(session->applyMutex);
+		session->audibility.reset();
+		session->refresh.reset();
+	}
+	uint64 currentChannelID = dpar_getMyCurrentChannel(serverConnectionHandlerID);
+
+	ClientlibPtr<anyID> clientidlist(DPAR_CLIENTLIB_SITE("resetPositions channel clients"));
+	ts3Functions.getChannelClientList(serverConnectionHandlerID, currentChannelID, clientidlist.out());
+	if (clientidlist.get() == NULL) {
+		return;
+	}
+
+	for (int i = 0; clientidlist[i]; ++i) {
+		TS3_VECTOR position;
+
+		position.x = 0.0f;
+		position.y = 0.0f;
+		position.z = 0.0f;
+		ts3Functions.channelset3DAttributes(serverConnectionHandlerID, clientidlist[i], &position);
+	}
+}
+
+bool dpar_channelNeedsPositions(uint64 serverConnectionHandlerID) {
+	uint64 currentChannelID = dpar_getMyCurrentChannel(serverConnectionHandlerID);
+
+	ClientlibPtr<anyID> clientidlist(DPAR_CLIENTLIB_SITE("channelNeedsPositions channel clients"));
+	ts3Functions.getChannelClientList(serverConnectionHandlerID, currentChannelID, clientidlist.out());
+	if (clientidlist.get() == NULL) {
+		return false;
+	}
+
+	//If there is only one client in the list then there's no need for positional audio
+	//two clients are the minimum for position to be useful since it's the relative position
+	return clientidlist[1] != 0;
+}
+
+void dpar_applyPositions(uint64 serverConnectionHandlerID, ReportingEndpoint& endpoint, json::value response, pplx::cancellation_token token, std::chrono::steady_clock::time_point deadline) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL || token.is_canceled()) {
+		return;
+	}
+
+	if (std::chrono::steady_clock::now() > deadline) {
+		// Positions this old would only drag everyone back to where they were, the next request has fresher ones
+		session->ticksLateDropped++;
+		return;
+	}
+	session->ticksOnTime++;
+
+	// One apply at a time, it's the only writer of the scratch below
+	std::unique_lock<std::mutex> applying(session->applyMutex);
+
+	// Scratch for this tick, everything the last one left in the arena is handed back here
+	std::pmr::memory_resource* tick = session->arena.begin();
+
 	uint64 currentChannelID = dpar_getMyCurrentChannel(serverConnectionHandlerID);
 
 	string localClientUID = dpar_getMyClientUID(serverConnectionHandlerID);
 
-	anyID* clientidlist = NULL;
-	ts3Functions.getChannelClientList(serverConnectionHandlerID, currentChannelID, &clientidlist);
-	if (clientidlist == NULL) {
+	ClientlibPtr<anyID> clientidlist(DPAR_CLIENTLIB_SITE("applyPositions channel clients"));
+	ts3Functions.getChannelClientList(serverConnectionHandlerID, currentChannelID, clientidlist.out());
+	if (clientidlist.get() == NULL) {
 		return;
 	}
 	
 	//If there is only one client in the list then there's no need for positional audio
 	//two clients are the minimum for position to be useful since it's the relative position
-	if (clientidlist[1] == NULL) {
+	if (clientidlist[1] == 0) {
 		return;
 	}
 
@@ -246,48 +1024,53 @@ void dpar_update3Dposition(uint64 serverConnectionHandlerID) {
 	up.y = 1.0f;
 	up.z = 0.0f;
 
-	printf("DPAR: Update position\n");
-
-	// Create http_client to send the request.
-	const std::string candidateUri = "http://" + ServerHost + ":" + ServerPort + "";
-
-	utility::string_t concatStr = utility::conversions::to_string_t(candidateUri);
-
-	web::http::client::http_client client(concatStr);
-
 	try {
-		// Build request URI and start the request.
-		uri_builder builder(U("/request"));
-		builder.append_query(U("id"), conversions::to_string_t(localClientUID)); //May turn the pointer to a string not the ID.... std::to_string(*id)
-		http_response response = client.request(methods::GET, builder.to_string()).get();
-		
 		//Parse network response
-		json::object responseJson = response.extract_json().get().as_object();
+		json::object& responseJson = response.as_object();
 
-		json::object flags = responseJson[L"flags"].as_object();
+		json::object& flags = responseJson[L"flags"].as_object();
 
-		//Check flags
-		if (flags[L"hasConfigUpdate"].as_bool()) {
-			dpar_updateFromRemoteConfiguration(serverConnectionHandlerID);
+		//Check flags, a config sent along with the positions is applied before them so both take effect on the same tick
+		json::object::iterator inlineConfig = responseJson.find(L"config");
+		if (inlineConfig != responseJson.end()) {
+			if (dpar_applyInlineConfiguration(*session, endpoint.uri, inlineConfig->second.as_object())) {
+				ts3Functions.logMessage("Updated attenuation config from position response", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+			}
+		}
+		else if (flags[L"hasConfigUpdate"].as_bool()) {
+			// Server doesn't inline configs, fetch it separately
+			dpar_queueConfigRefresh(serverConnectionHandlerID);
 		}
 
-		json::object playerData = responseJson[L"players"].as_object();
+		// Read through the index only, looking a key up with operator[] would insert it when it's missing
+		const json::object& playerData = responseJson[L"players"].as_object();
+		PlayerIndex& index = session->playerIndex;
+		index.build(playerData);
+
+		// Talkers placed this tick, gathered raw and transformed together once everyone's been read
+		PlayerStore& players = session->players;
+		players.clear();
+		TS3_VECTOR listenerForward;
+		ChannelSet hears(tick);
+		bool haveListener = false;
+
+		session->whisper.begin();
+		session->mutes.begin(std::chrono::steady_clock::now());
 
 		//While clientidlist[i] not null
 		for (int i = 0; clientidlist[i]; ++i) {
 
-			char* clientUID = NULL;
-			ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientidlist[i], CLIENT_UNIQUE_IDENTIFIER, &clientUID);
+			ClientlibString clientUIDBuffer(DPAR_CLIENTLIB_SITE("applyPositions client UID"));
+			ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientidlist[i], CLIENT_UNIQUE_IDENTIFIER, clientUIDBuffer.out());
+			const char* clientUID = clientUIDBuffer.get();
 			if (clientUID == NULL) {
 				return;
 			}
-			std::string clientstr(clientUID);
-			string_t clientid = conversions::to_string_t(clientstr);
 
 			if (playerData.size() == 0) {
 
 				// If it's ourselves
-				if (localClientUID == clientstr) {
+				if (localClientUID == clientUID) {
 					continue;
 				}
 
@@ -297,122 +1080,324 @@ void dpar_update3Dposition(uint64 serverConnectionHandlerID) {
 				position.y = 0.0f;
 				position.z = 0.0f;
 
-				if (!CanHearUnregistered) {
+				if (!session->canHearUnregistered) {
 					position.y = -1024.0f;
 				}
 
 				ts3Functions.channelset3DAttributes(serverConnectionHandlerID, clientidlist[i], &position);
 
+				// No positions from the server at all, nobody can be ruled out
+				session->whisper.include(clientidlist[i]);
+
 				continue;
 			}
 
 
-			//Set cross matched users 3D positions
-			if (playerData[conversions::to_string_t(std::to_string(clientidlist[i]))] != NULL) {
+			//Set cross matched users 3D positions, one probe of the index per client
+			const json::value* player = index.find(clientUID);
+
+			// We have data for a user and they're not the local user
+			if (player != NULL && player->is_object() && localClientUID != clientUID) {
+
+				//printf("Setting position for %s to %f, %f, %f\n", clientUID, posArray[0].as_double(), posArray[1].as_double(), posArray[2].as_double());
+
+				// Only players in local mode are sent with a position, the rest are heard from their channel's origin
+				const json::value& channel = player->at(L"ch");
+				const bool local = channel.at(L"mode").as_string() == U("local");
+				float x = 0.0f;
+				float y = 0.0f;
+				float z = 0.0f;
+				if (local) {
+					const json::value& pos = player->at(L"pos");
+					x = (float)pos.at(L"x").as_double();
+					y = (float)pos.at(L"y").as_double();
+					z = (float)pos.at(L"z").as_double();
+				}
+				const float yaw = player->has_field(L"rot") ? (float)player->at(L"rot").at(L"y").as_double() : 0.0f;
+
+				players.add(clientidlist[i], x, y, z, yaw, (int32_t)channel.at(L"id").as_double(), local);
+			}
+			else if (localClientUID != clientUID) {
+				//Player probably isn't registered
+				TS3_VECTOR position;
+				position.x = 0.0f;
+				position.y = 0.0f;
+				position.z = 0.0f;
+
+				if (!session->canHearUnregistered) {
+					position.y = -1024.0f;
+				}
+				else {
+					session->whisper.include(clientidlist[i]);
+				}
 
-				// We have data for a user and they're not the local user
-				if (playerData[clientid].is_object() && localClientUID != clientstr) {
+				ts3Functions.channelset3DAttributes(serverConnectionHandlerID, clientidlist[i], &position);
+			}
+			else if (player != NULL && player->is_object()) {
+				//TS user is player
+
+				double pitch = 0.0f;//Pitch isn't sent as it isn't useful in the calculation below - pitch only makes sense when combined with roll which isn't present
+				double yaw = player->at(L"rot").at(L"y").as_double() + (3.14 * 1.5);//r is shortened rotation, y is shortened yaw
+
+				double xzLen = cos(pitch);
+				double x = xzLen * cos(yaw);
+				double y = sin(pitch);
+				double z = xzLen * sin(-yaw);
+
+				TS3_VECTOR new_forward;
+				new_forward.x = (float)x;
+				new_forward.y = (float)y;
+				new_forward.z = (float)z;
+
+				// Our own channel, plus any radio or party channels we're tuned to
+				const json::value& channel = player->at(L"ch");
+				hears.insert((int32_t)channel.at(L"id").as_double());
+				if (channel.has_field(L"hears") && channel.at(L"hears").is_array()) {
+					const json::array& tuned = channel.at(L"hears").as_array();
+					for (size_t c = 0; c < tuned.size(); ++c) {
+						if (tuned.at(c).is_number()) {
+							hears.insert(tuned.at(c).as_integer());
+						}
+					}
+				}
 
-					TS3_VECTOR position;
-					//printf("Setting position for %s to %f, %f, %f\n", clientstr.c_str(), posArray[0].as_double(), posArray[1].as_double(), posArray[2].as_double());
+				ts3Functions.systemset3DSettings(serverConnectionHandlerID, 1.0f, 1.0f);
+				ts3Functions.systemset3DListenerAttributes(serverConnectionHandlerID, &center, &new_forward, &up);
 
-					// Modifier added onto y-pos to simulate channels by placing clients vertically about each other
-					double channel_y_mod = RolloffCutoff * 4 * playerData[clientid][L"ch"][L"id"].as_double();
+				listenerForward = new_forward;
+				haveListener = true;
 
-					if (playerData[clientid][L"ch"][L"mode"].as_string() == U("local")) {
-						position.x = -1 * playerData[clientid][L"pos"][L"x"].as_double();
-						position.y = playerData[clientid][L"pos"][L"y"].as_double() + channel_y_mod;
-						position.z = playerData[clientid][L"pos"][L"z"].as_double();
+				// Environment the listener is standing in, picks the shared reverb
+				DparEnvironment environment = DPAR_ENV_NONE;
+				if (player->has_field(L"env")) {
+					const json::value& env = player->at(L"env");
+					if (env.is_string()) {
+						environment = dpar_environmentFromName(conversions::to_utf8string(env.as_string()));
 					}
-					else {
-						position.x = 0.0f;
-						position.y = channel_y_mod;
-						position.z = 0.0f;
+					else if (env.is_number() && env.as_integer() > DPAR_ENV_NONE && env.as_integer() < DPAR_ENV_COUNT) {
+						environment = (DparEnvironment)env.as_integer();
 					}
+				}
+				session->reverb.setEnvironment(environment);
+			}
+
+		}
+
+		// Mirrors x for the whole channel at once before handing the positions to TeamSpeak
+		players.transform();
+
+		// Without our own position there's no telling which channels we hear, so nobody is silenced
+		std::pmr::vector<uint8_t> audible(tick);
+		if (haveListener) {
+			players.audibleMask(hears, audible);
+		}
+		else {
+			audible.assign(players.size(), 1);
+		}
 
-					ts3Functions.channelset3DAttributes(serverConnectionHandlerID, clientidlist[i], &position);
+		// We're always at the origin, so distances are known before anything is pushed
+		players.measure(center);
 
-					//free(&posArray);
-					//free(&forward);
-					//free(&up);
+		// In a channel too big to push everyone each tick, anyone near enough to hear goes and the rest take turns
+		std::pmr::vector<uint8_t> push(tick);
+		session->refresh.plan(players, audible, session->rolloffCutoff * DPAR_MUTE_ENGAGE, ApplyBudget, push);
+
+		// Talkers in a channel we can't hear aren't placed at all, they're held at zero gain until we can
+		std::pmr::vector<anyID> silenced(tick);
+		for (size_t i = 0; i < players.size(); ++i) {
+			if (push[i]) {
+				TS3_VECTOR position = players.position(i);
+				ts3Functions.channelset3DAttributes(serverConnectionHandlerID, players.client(i), &position);
+			}
+			else if (!audible[i]) {
+				silenced.push_back(players.client(i));
+			}
+		}
+		session->audibility.update(silenced);
+
+		if (haveListener) {
+			// Listener's right hand side in TeamSpeak's left handed space is up x forward
+			const float rightX = listenerForward.z;
+			const float rightZ = -listenerForward.x;
+
+			std::pmr::vector<std::pair<anyID, float>> talkerDistances(tick);
+
+			// Beyond the cutoff the rolloff silences a talker, so its direction and reverb send can wait until it's back
+			std::pmr::vector<uint8_t> inRange(tick);
+			players.rangeMask(session->rolloffCutoff, inRange);
+
+			// Only talkers this close can make the whisper list, the rest needn't be offered to it
+			std::pmr::vector<uint8_t> nearby(tick);
+			players.rangeMask(session->rolloffCutoff * DPAR_WHISPER_LEAVE, nearby);
+
+			for (size_t i = 0; i < players.size(); ++i) {
+				if (!audible[i]) {
+					continue;
+				}
+
+				if (inRange[i]) {
+					const TS3_VECTOR p = players.position(i);
+					float azimuth = atan2(p.x * rightX + p.z * rightZ, p.x * listenerForward.x + p.z * listenerForward.z);
+					session->spatializer.setDirection(players.client(i), azimuth);
+					session->reverb.setSendDistance(players.client(i), players.distance(i) / session->rolloffCutoff);
+				}
+
+				if (nearby[i]) {
+					session->whisper.consider(players.client(i), players.distance(i), session->rolloffCutoff);
 				}
-				else {
-					if (!playerData[clientid].is_object() && localClientUID != clientstr) {
-						//Player probably isn't registered
-						TS3_VECTOR position;
-						position.x = 0.0f;
-						position.y = 0.0f;
-						position.z = 0.0f;
-
-						if (!CanHearUnregistered) {
-							position.y = -1024.0f;
-						}					
-						
-						ts3Functions.channelset3DAttributes(serverConnectionHandlerID, clientidlist[i], &position);
-
-						printf("Player likely not registered. with id = %s\n", clientstr.c_str());
-					}
-					else if (localClientUID == clientstr) {
-						//TS user is player
 
-						double pitch = 0.0f;//Pitch isn't sent as it isn't useful in the calculation below - pitch only makes sense when combined with roll which isn't present
-						double yaw = playerData[clientid][L"rot"][L"y"].as_double() + (3.14 * 1.5);//r is shortened rotation, y is shortened yaw
+				talkerDistances.push_back(std::make_pair(players.client(i), players.distance(i)));
+			}
 
-						double xzLen = cos(pitch);
-						double x = xzLen * cos(yaw);
-						double y = sin(pitch);
-						double z = xzLen * sin(-yaw);
+			// Read once under the apply lock, so once the menu has turned it off and released our mutes nothing here mutes again
+			const bool autoMute = AutoMute.load();
 
-						TS3_VECTOR new_forward;
-						new_forward.x = (float)x;
-						new_forward.y = (float)y;
-						new_forward.z = (float)z;
+			// Decided on this tick's distances before any mutes below, so a talker over budget is faded and muted together
+			session->budget.select(talkerDistances, VoiceBudget, autoMute, std::chrono::steady_clock::now());
 
-						center.y = RolloffCutoff * 4 * playerData[clientid][L"ch"][L"id"].as_double();
+			if (autoMute) {
+				for (size_t i = 0; i < players.size(); ++i) {
+					const anyID talker = players.client(i);
 
-						ts3Functions.systemset3DSettings(serverConnectionHandlerID, 1.0f, 1.0f);
-						ts3Functions.systemset3DListenerAttributes(serverConnectionHandlerID, &center, &new_forward, &up);
+					unsigned int reasons = 0;
+					if (!audible[i]) {
+						reasons |= DPAR_MUTE_OTHER_CHANNEL;
 					}
+					if (session->budget.isBenched(talker)) {
+						reasons |= DPAR_MUTE_OVER_BUDGET;
+					}
+					session->mutes.consider(talker, players.distance(i), session->rolloffCutoff, reasons, dpar_isClientMuted(serverConnectionHandlerID, talker));
 				}
-
-				//free(&clientstr);
-				//free(&clientid);
-				//ts3Functions.freeMemory(clientUID);
 			}
+		}
+		else {
+			// Without our own position distances mean nothing
+			for (size_t i = 0; i < players.size(); ++i) {
+				session->whisper.include(players.client(i));
+			}
+			session->budget.reset();
+		}
 
+		// Read under the apply lock, so once the menu has turned it off and cleared the list nothing here sends one again
+		if (ProximityWhisper.load()) {
+			dpar_sendWhisperList(serverConnectionHandlerID, *session);
 		}
 
+		// Anyone we muted but couldn't place this tick comes back, a client we can't place might be in range
+		std::pmr::vector<anyID> mute(tick);
+		std::pmr::vector<anyID> unmute(tick);
+		session->mutes.commit(mute, unmute);
+		dpar_sendMutes(serverConnectionHandlerID, mute, unmute);
+
 	}
 	catch (const std::exception& e) {
-		printf("An error occured or the connection timed out\n");
+		ts3Functions.logMessage("Position update failed or timed out", LogLevel_DEBUG, "DPAR", serverConnectionHandlerID);
+		applying.unlock();
+		dpar_resetPositions(serverConnectionHandlerID);
+	}
+}
 
-		//The following resets the clients positions - this is needed for when positional audio is not being used
-		for (int i = 0; clientidlist[i]; ++i) {
-			char* clientUID = NULL;
-			ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientidlist[i], CLIENT_UNIQUE_IDENTIFIER, &clientUID);
-			if (clientUID == NULL) {
-				return;
-			}
+// Requests everyone's position and applies it on the I/O executor, the task completes once it's applied
+// Lets the next tick send a request, counting this one if it ran out of time
+void dpar_finishPositionRequest(uint64 serverConnectionHandlerID, bool timedOut) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+	session->positionRequestInFlight = false;
+	if (timedOut) {
+		session->ticksTimedOut++;
+	}
+}
 
+// Sends /request to one server. If it fails with time left before the deadline, the request goes again to the next best server
+// the channel names, so a dead server costs at most one failed attempt rather than the update
+pplx::task<void> dpar_sendPositionRequest(uint64 serverConnectionHandlerID, std::shared_ptr<ReportingEndpoint> endpoint, uint64_t configVersion,
+		pplx::cancellation_token token, std::chrono::steady_clock::time_point deadline, std::set<std::string> tried) {
+	pplx::task_options options(token, IoContinuations);
+	const std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
 
-			std::string clientstr(clientUID);
-			string_t clientid = conversions::to_string_t(clientstr);
+	return pplx::create_task([serverConnectionHandlerID, endpoint, token, configVersion]() {
+		string localClientUID = dpar_getMyClientUID(serverConnectionHandlerID);
 
-			TS3_VECTOR position;
+		// Build request URI and start the request.
+		uri_builder builder(U("/request"));
+		builder.append_query(U("id"), conversions::to_string_t(localClientUID)); //May turn the pointer to a string not the ID.... std::to_string(*id)
+		builder.append_query(U("configVersion"), conversions::to_string_t(std::to_string(configVersion)));
+		return endpoint->tickClient.request(methods::GET, builder.to_string(), token);
+	}, options).then([](http_response response) {
+		return response.extract_json();
+	}, options).then([serverConnectionHandlerID, endpoint, configVersion, token, deadline, tried, sent](pplx::task<json::value> positions) {
+		// No token here so this always runs and observes the result, even once cancelled
+		json::value response;
+		try {
+			response = dpar_observeResponse(serverConnectionHandlerID, *endpoint, positions, sent);
+		}
+		catch (const pplx::task_canceled&) {
+			// Left the channel while the request was out
+			dpar_finishPositionRequest(serverConnectionHandlerID, false);
+			return pplx::task_from_result();
+		}
+		catch (const std::exception& e) {
+			SessionRef session = Sessions.find(serverConnectionHandlerID);
+			const bool timeLeft = std::chrono::steady_clock::now() < deadline;
+
+			if (session != NULL && timeLeft && !token.is_canceled()) {
+				std::set<std::string> excluded = tried;
+				excluded.insert(endpoint->uri);
+
+				std::shared_ptr<ReportingEndpoint> next = dpar_reportingEndpoint(*session, excluded);
+				if (next) {
+					ts3Functions.logMessage("Position request failed, retrying on another reporting server", LogLevel_DEBUG, "DPAR", serverConnectionHandlerID);
+					return dpar_sendPositionRequest(serverConnectionHandlerID, next, configVersion, token, deadline, excluded);
+				}
+			}
 
-			position.x = 0.0f;
-			position.y = 0.0f;
-			position.z = 0.0f;
-			ts3Functions.channelset3DAttributes(serverConnectionHandlerID, clientidlist[i], &position);
+			// Already counted against the endpoint, only the deadline is of interest here
+			dpar_finishPositionRequest(serverConnectionHandlerID, !timeLeft);
+			return pplx::task_from_result();
 		}
+
+		// The next request only goes out once this one is applied, so a fast response can't start a second apply alongside
+		dpar_applyPositions(serverConnectionHandlerID, *endpoint, response, token, deadline);
+		dpar_finishPositionRequest(serverConnectionHandlerID, false);
+		return pplx::task_from_result();
+	}, pplx::task_options(IoContinuations));
+}
+
+pplx::task<void> dpar_requestPositionUpdate(uint64 serverConnectionHandlerID, pplx::cancellation_token token) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL || !dpar_channelNeedsPositions(serverConnectionHandlerID)) {
+		return pplx::task_from_result();
+	}
+
+	// A slow server shouldn't stack requests up, the first tick after the response sends the next one
+	if (session->positionRequestInFlight.exchange(true)) {
+		return pplx::task_from_result();
 	}
 
-	//free(&client);
-	//free(&builder);
-	//free(&response);
-	//free(&jsonVal);
-	//ts3Functions.freeMemory(clientidlist);
-	//ts3Functions.freeMemory(&channelID);
+	// While every server is down only the occasional probe goes out
+	std::shared_ptr<ReportingEndpoint> endpoint = dpar_reportingEndpoint(*session);
+	if (!endpoint) {
+		session->positionRequestInFlight = false;
+		return pplx::task_from_result();
+	}
+
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(DPAR_REQUEST_DEADLINE_MS);
+
+	// Tells the server which config we hold so it can send a newer one inline
+	const uint64_t configVersion = session->configVersion;
+
+	return dpar_trackAsync(dpar_sendPositionRequest(serverConnectionHandlerID, endpoint, configVersion, token, deadline, std::set<std::string>()));
+}
+
+void dpar_update3Dposition(uint64 serverConnectionHandlerID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	dpar_requestPositionUpdate(serverConnectionHandlerID, dpar_channelToken(*session));
 }
 
 #pragma endregion
@@ -449,6 +1434,7 @@ const char* ts3plugin_description() {
 /* Set TeamSpeak 3 callback functions */
 void ts3plugin_setFunctionPointers(const struct TS3Functions funcs) {
     ts3Functions = funcs;
+    dpar_clientlibInit(ts3Functions.freeMemory);
 }
 
 /*
@@ -477,7 +1463,23 @@ int ts3plugin_init() {
 
 	printf("PLUGIN: App path: %s\nResources path: %s\nConfig path: %s\nPlugin path: %s\n", appPath, resourcesPath, configPath, pluginPath);
 
-	t = Timer();
+	dpar_latencyStart();
+	IoWork.start(DPAR_IO_WORKERS);
+	Ticks.start();
+
+	// Seed every endpoint we knew last time, used straight away and revalidated when first needed
+	if (Cache.load(std::string(configPath) + DPAR_CACHE_FILE)) {
+		std::map<std::string, CachedConfig> cached = Cache.allConfigs();
+		for (std::map<std::string, CachedConfig>::const_iterator it = cached.begin(); it != cached.end(); ++it) {
+			try {
+				Endpoints.get(it->first)->seedConfig(it->second.config, it->second.validator);
+			}
+			catch (const std::exception& e) {
+				// Not a usable address any more, dropped next time the cache is written
+			}
+		}
+		ts3Functions.logMessage("Loaded config cache", LogLevel_INFO, "DPAR", 0);
+	}
 
     return 0;  /* 0 = success, 1 = failure, -2 = failure but client will not show a "failed to load" warning */
 	/* -2 is a very special case and should only be used if a plugin displays a dialog (e.g. overlay) asking the user to disable
@@ -490,6 +1492,25 @@ void ts3plugin_shutdown() {
     /* Your plugin cleanup code here */
     printf("PLUGIN: shutdown\n");
 
+	// Nothing new starts, what's in flight is cancelled and gets a bounded time to settle before the DLL goes away
+	Ticks.stop();
+	Sessions.forEach([](ServerSession& session) {
+		dpar_persistChannelIndex(session);
+		dpar_cancelConnectionWork(session);
+
+		// Our mutes would otherwise outlive the plugin
+		dpar_releaseMutes(session.serverConnectionHandlerID);
+	});
+	if (!IoWork.drain(std::chrono::milliseconds(DPAR_SHUTDOWN_DRAIN_MS))) {
+		ts3Functions.logMessage("Reporting server requests still outstanding at shutdown, dropping them", LogLevel_WARNING, "DPAR", 0);
+	}
+	IoWork.stop();
+	if (!Cache.save()) {
+		ts3Functions.logMessage("Failed to write config cache", LogLevel_WARNING, "DPAR", 0);
+	}
+	Endpoints.clear();
+	dpar_latencyStop();
+
 	/*
 	 * Note:
 	 * If your plugin implements a settings dialog, it must be closed and deleted here, else the
@@ -532,6 +1553,109 @@ void ts3plugin_registerPluginID(const char* id) {
 	printf("PLUGIN: registerPluginID: %s\n", pluginID);
 }
 
+/* Plugin command keyword. Return NULL or "" if not used. */
+const char* ts3plugin_commandKeyword() {
+	return "dpar";
+}
+
+/* Plugin processes console command. Return 0 if plugin handled the command, 1 if not handled. */
+int ts3plugin_processCommand(uint64 serverConnectionHandlerID, const char* command) {
+	std::string cmd(command);
+
+	if (cmd == "latency") {
+		std::string summary = "DPAR audio callback latency:\n" + dpar_latencySummary();
+		ts3Functions.printMessage(serverConnectionHandlerID, summary.c_str(), PLUGIN_MESSAGE_TARGET_SERVER);
+		return 0;
+	}
+
+	if (cmd.compare(0, 6, "budget") == 0) {
+		char msg[128];
+		if (cmd.size() > 7) {
+			const int limit = atoi(cmd.c_str() + 7);
+			VoiceBudget = limit > 0 ? limit : 0;
+		}
+		if (VoiceBudget > 0) {
+			snprintf(msg, sizeof(msg), "DPAR voice budget: %d nearest talkers", (int)VoiceBudget);
+		}
+		else {
+			snprintf(msg, sizeof(msg), "DPAR voice budget: unlimited");
+		}
+		ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+		return 0;
+	}
+
+	if (cmd.compare(0, 11, "applybudget") == 0) {
+		char msg[128];
+		if (cmd.size() > 12) {
+			const int limit = atoi(cmd.c_str() + 12);
+			ApplyBudget = limit > 0 ? limit : 0;
+		}
+		if (ApplyBudget > 0) {
+			snprintf(msg, sizeof(msg), "DPAR apply budget: %d position updates a tick", (int)ApplyBudget);
+		}
+		else {
+			snprintf(msg, sizeof(msg), "DPAR apply budget: unlimited");
+		}
+		ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+		return 0;
+	}
+
+	if (cmd == "latency reset") {
+		dpar_latencyReset();
+		ts3Functions.printMessage(serverConnectionHandlerID, "DPAR latency histograms cleared", PLUGIN_MESSAGE_TARGET_SERVER);
+		return 0;
+	}
+
+	return 1;  /* Plugin did not handle command */
+}
+
+/* Static title shown in the left column in the info frame */
+const char* ts3plugin_infoTitle() {
+	return "DPAR";
+}
+
+/*
+ * Dynamic content shown in the right column in the info frame. Memory for the data string needs to be allocated in this
+ * function. The client will call ts3plugin_freeMemory once done with the string to release the allocated memory again.
+ */
+void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type, char** data) {
+	if (type != PLUGIN_SERVER) {
+		*data = NULL;  /* Nothing to show for channels and clients */
+		return;
+	}
+
+	std::string info = "Audio callback latency:\n" + dpar_latencySummary();
+
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session != NULL) {
+		char spatializerCost[INFODATA_BUFSIZE];
+		snprintf(spatializerCost, INFODATA_BUFSIZE, "Spatializer: %.2fus per talker block\n", session->spatializer.averageBlockMicroseconds());
+
+		char tickOutcomes[INFODATA_BUFSIZE];
+		snprintf(tickOutcomes, INFODATA_BUFSIZE, "Position requests: %llu on time, %llu late and dropped, %llu timed out\n",
+			(unsigned long long)session->ticksOnTime, (unsigned long long)session->ticksLateDropped, (unsigned long long)session->ticksTimedOut);
+
+		char applied[INFODATA_BUFSIZE];
+		snprintf(applied, INFODATA_BUFSIZE, "Position pushes: %u last tick, %u deferred\n", session->refresh.sentLastTick(), session->refresh.deferredLastTick());
+
+		char arenaUse[INFODATA_BUFSIZE];
+		snprintf(arenaUse, INFODATA_BUFSIZE, "Tick arena: %llu KB, %u overflow spills last tick, %llu in all\n",
+			(unsigned long long)(session->arena.bytes() / 1024), session->arena.lastTickSpills(), (unsigned long long)session->arena.spills());
+
+		info += spatializerCost;
+		info += tickOutcomes;
+		info += applied;
+		info += arenaUse;
+
+#ifdef DPAR_TRACK_CLIENTLIB
+		info += "Client library memory:\n" + dpar_clientlibSummary();
+#endif
+	}
+
+	*data = (char*)malloc((info.size() + 1) * sizeof(char));
+	_strcpy(*data, info.size() + 1, info.c_str());
+}
+
 /* Required to release the memory for parameter "data" allocated in ts3plugin_infoData and ts3plugin_initMenus */
 void ts3plugin_freeMemory(void* data) {
 	free(data);
@@ -571,7 +1695,10 @@ enum {
 	MENU_ID_CHANNEL_DISABLE,
 	MENU_ID_GLOBAL_ENABLE,
 	MENU_ID_GLOBAL_DISABLE,
-	MENU_ID_REFRESH_CONFIGURATION
+	MENU_ID_REFRESH_CONFIGURATION,
+	MENU_ID_TOGGLE_SPATIALIZER,
+	MENU_ID_TOGGLE_PROXIMITY_WHISPER,
+	MENU_ID_TOGGLE_AUTO_MUTE
 };
 
 /*
@@ -598,8 +1725,11 @@ void ts3plugin_initMenus(struct PluginMenuItem*** menuItems, char** menuIcon) {
 	 * e.g. for "test_plugin.dll", icon "1.png" is loaded from <TeamSpeak 3 Client install dir>\plugins\test_plugin\1.png
 	 */
 
-	BEGIN_CREATE_MENUS(1);  /* IMPORTANT: Number of menu items must be correct! */
+	BEGIN_CREATE_MENUS(4);  /* IMPORTANT: Number of menu items must be correct! */
 	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_REFRESH_CONFIGURATION, "Refresh configuration", "3.png");
+	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_TOGGLE_SPATIALIZER, "Toggle binaural spatializer", "2.png");
+	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_TOGGLE_PROXIMITY_WHISPER, "Toggle proximity whisper", "1.png");
+	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_TOGGLE_AUTO_MUTE, "Toggle auto-mute out of range talkers", "1.png");
 	END_CREATE_MENUS;  /* Includes an assert checking if the number of menu items matched */
 
 	/*
@@ -632,6 +1762,27 @@ void ts3plugin_initMenus(struct PluginMenuItem*** menuItems, char** menuIcon) {
 /* Clientlib */
 
 void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int newStatus, unsigned int errorNumber) {
+	if (newStatus == STATUS_DISCONNECTED) {
+		// Nothing to update until we're connected and in a channel again, the slot goes to the next connection
+		Ticks.cancel(serverConnectionHandlerID);
+		SessionRef session = Sessions.find(serverConnectionHandlerID);
+		if (session != NULL) {
+			dpar_persistChannelIndex(*session);
+			dpar_cancelConnectionWork(*session);
+			dpar_queueCacheSave();
+		}
+		Sessions.release(serverConnectionHandlerID);
+	}
+	else if (newStatus == STATUS_CONNECTION_ESTABLISHED) {
+		if (Sessions.acquire(serverConnectionHandlerID) == NULL) {
+			ts3Functions.logMessage("Too many server connections, positional audio disabled for this one", LogLevel_WARNING, "DPAR", serverConnectionHandlerID);
+		}
+		else {
+			// Before the channel walk below, which corrects anything that changed since
+			dpar_restoreChannelIndex(serverConnectionHandlerID);
+		}
+	}
+
     /* Some example code following to show how to use the information query functions. */
 
     if(newStatus == STATUS_CONNECTION_ESTABLISHED) {  /* connection established and we have client and channels available */
@@ -685,7 +1836,7 @@ void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int
         printf("PLUGIN: My client ID = %d, nickname = %s\n", myID, s);
         ts3Functions.freeMemory(s);
 
-        /* Print list of all channels on this server */
+        /* Print list of all channels on this server, indexing the reporting servers they name as we go */
         if(ts3Functions.getChannelList(serverConnectionHandlerID, &ids) != ERROR_ok) {
             ts3Functions.logMessage("Error getting channel list", LogLevel_ERROR, "DPAR", serverConnectionHandlerID);
             return;
@@ -699,6 +1850,8 @@ void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int
             }
             printf("PLUGIN: Channel ID = %llu, name = %s\n", (long long unsigned int)ids[i], s);
             ts3Functions.freeMemory(s);
+
+            dpar_indexOtherChannel(serverConnectionHandlerID, ids[i]);
         }
         ts3Functions.freeMemory(ids);  /* Release array */
 
@@ -732,20 +1885,20 @@ void ts3plugin_onUpdateChannelEditedEvent(uint64 serverConnectionHandlerID, uint
 
 		ts3Functions.logMessage("Channel we are in was edited", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
 
-		t.stop();
+		SessionRef session = Sessions.acquire(serverConnectionHandlerID);
+		if (session == NULL) {
+			return;
+		}
+
+		dpar_cancelChannelWork(*session);
+		Ticks.cancel(serverConnectionHandlerID);
 		printf("DPAR: Kill timer\n");
 
 		dpar_updateConfigFromChannelDescription(serverConnectionHandlerID, channelID);
 
-		if (ChannelHasConfig) {
-			// Attempt to get new parameters from the remote
-			dpar_updateFromRemoteConfiguration(serverConnectionHandlerID);
-
-			// Update the 3D positions of clients without delay
-			dpar_update3Dposition(serverConnectionHandlerID);
-
-			// Schedule updates on an interval
-			t.setTimeout(&dpar_setIntervalForTimer, serverConnectionHandlerID, 500);
+		if (session->channelHasConfig) {
+			// Config fetch, first update and timer start are chained on the I/O executor
+			dpar_queueChannelJoin(serverConnectionHandlerID);
 		}
 	}
 }
@@ -758,6 +1911,14 @@ void ts3plugin_onClientMoveMovedEvent(uint64 serverConnectionHandlerID, anyID cl
 	dpar_clientMoveEvent(serverConnectionHandlerID, clientID, newChannelID);
 }
 
+void ts3plugin_onTalkStatusChangeEvent(uint64 serverConnectionHandlerID, int status, int isReceivedWhisper, anyID clientID) {
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session != NULL) {
+		// Only talkers compete for the voice budget, picked up on the next position update
+		session->budget.setTalking(clientID, status == STATUS_TALKING);
+	}
+}
+
 int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* errorMessage, unsigned int error, const char* returnCode, const char* extraMessage) {
 	printf("PLUGIN: onServerErrorEvent %llu %s %d %s\n", (long long unsigned int)serverConnectionHandlerID, errorMessage, error, (returnCode ? returnCode : ""));
 	if(returnCode) {
@@ -778,23 +1939,39 @@ void ts3plugin_onChannelDescriptionUpdateEvent(uint64 serverConnectionHandlerID,
 		// Attempt to update the remote host details from description
 		dpar_updateConfigFromChannelDescription(serverConnectionHandlerID, channelID);
 
-		if (ChannelHasConfig) {
+		SessionRef session = Sessions.find(serverConnectionHandlerID);
+		if (session != NULL && session->channelHasConfig) {
 			// Attempt to update config from the remote host
-			dpar_updateFromRemoteConfiguration(serverConnectionHandlerID);
+			dpar_queueConfigRefresh(serverConnectionHandlerID);
 		}
 	}
+	else {
+		dpar_indexOtherChannel(serverConnectionHandlerID, channelID);
+	}
 	cout << "ts3plugin_onChannelDescriptionUpdateEvent" << endl;
 }
 
+void ts3plugin_onNewChannelCreatedEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 channelParentID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier) {
+	dpar_indexOtherChannel(serverConnectionHandlerID, channelID);
+}
+
+void ts3plugin_onDelChannelEvent(uint64 serverConnectionHandlerID, uint64 channelID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier) {
+	dpar_forgetChannel(serverConnectionHandlerID, channelID);
+}
+
 void ts3plugin_onCustom3dRolloffCalculationClientEvent(uint64 serverConnectionHandlerID, anyID clientID, float distance, float* volume) {
-	std::string strdistance = "\nDistance of client:";
-	strdistance = strdistance.append(std::to_string(distance));
-	//printf(strdistance.c_str());
-	std::string strvolume = "\nVolume of client:";
-	strvolume = strvolume.append(std::to_string(*volume));
-	//printf(strvolume.c_str());
-
-	if (distance < RolloffOffset) {
+	LatencyScope latency(DPAR_PROBE_ROLLOFF);
+
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	const float offset = session->rolloffOffset.load(std::memory_order_relaxed);
+	const float cutoff = session->rolloffCutoff.load(std::memory_order_relaxed);
+	const float attenuationCoefficient = session->rolloffAttenuationCoefficient.load(std::memory_order_relaxed);
+
+	if (distance < offset) {
 		*volume = 1.0f;
 	}
 	else {
@@ -802,28 +1979,79 @@ void ts3plugin_onCustom3dRolloffCalculationClientEvent(uint64 serverConnectionHa
 		//1-\left(\frac{\left(\operatorname{abs}\left(x\right)-a\right)}{b-a}\right)^{c}\left\{\operatorname{abs}\left(x\right)>a\right\}
 		//y=1\left\{\operatorname{abs}\left(x\right)<a\right\}
 
-		float v = 1.0f - pow(((distance - RolloffOffset)/(RolloffCutoff-RolloffOffset)),RolloffAttenuationCoefficient);
+		float v = 1.0f - pow(((distance - offset)/(cutoff-offset)),attenuationCoefficient);
 		if (v < 0.0f) {
 			v = 0.0f;
 		}
 		*volume = v;
 	}
 
+	if (session->audibility.isSilenced(clientID)) {
+		// In a game channel we can't hear
+		*volume = 0.0f;
+	}
+
+	if (session->budget.isBenched(clientID)) {
+		// Over the voice budget, with gain smoothing on this fades them out over the next frame
+		*volume = 0.0f;
+	}
+
+	if (GainSmoothing) {
+		// The gain is applied by ts3plugin_onEditPlaybackVoiceDataEvent so it can be ramped over the frame
+		session->gains.setTarget(clientID, *volume);
+		*volume = 1.0f;
+	}
+}
+
+void ts3plugin_onEditPlaybackVoiceDataEvent(uint64 serverConnectionHandlerID, anyID clientID, short* samples, int sampleCount, int channels) {
+	LatencyScope latency(DPAR_PROBE_PLAYBACK);
 
-	strdistance.erase();
-	strvolume.erase();
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session != NULL && GainSmoothing) {
+		session->gains.process(clientID, samples, sampleCount, channels);
+	}
 }
 
-void ts3plugin_onCustom3dRolloffCalculationWaveEvent(uint64 serverConnectionHandlerID, uint64 waveHandle, float distance, float* volume) {
-	std::string strdistance = "\nDistance of client:";
-	strdistance = strdistance.append(std::to_string(distance));
-	//printf(strdistance.c_str());
-	std::string strvolume = "\nVolume of client:";
-	strvolume = strvolume.append(std::to_string(*volume));
-	//printf(strvolume.c_str());
+void ts3plugin_onEditPostProcessVoiceDataEvent(uint64 serverConnectionHandlerID, anyID clientID, short* samples, int sampleCount, int channels, const unsigned int* channelSpeakerArray, unsigned int* channelFillMask) {
+	LatencyScope latency(DPAR_PROBE_POSTPROCESS);
+
+	// Read once so the menu flipping it mid frame can't leave the frame half processed
+	const bool spatialize = SpatializerEnabled.load(std::memory_order_relaxed);
+
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session == NULL) {
+		return;
+	}
+
+	// Fast path for frames nobody can hear: out of range clients and silence skip every DSP stage
+	bool silent = *channelFillMask == 0;
+	if (!silent) {
+		silent = GainSmoothing ? session->gains.wasSilent(clientID) : dpar_peakAbs(samples, sampleCount * channels) <= DPAR_SILENCE_PEAK;
+	}
+	if (silent) {
+		*channelFillMask = 0;
+		session->spatializer.rest(clientID);
+		return;
+	}
+
+	// The reverb send takes TeamSpeak's panned output before the spatializer replaces it
+	session->reverb.send(clientID, samples, sampleCount, channels, *channelFillMask);
 
-	strdistance.erase();
-	strvolume.erase();
+	if (spatialize) {
+		session->spatializer.process(clientID, samples, sampleCount, channels, channelSpeakerArray, channelFillMask);
+	}
+}
+
+void ts3plugin_onEditMixedPlaybackVoiceDataEvent(uint64 serverConnectionHandlerID, short* samples, int sampleCount, int channels, const unsigned int* channelSpeakerArray, unsigned int* channelFillMask) {
+	LatencyScope latency(DPAR_PROBE_MIXED);
+
+	SessionRef session = Sessions.find(serverConnectionHandlerID);
+	if (session != NULL) {
+		session->reverb.process(samples, sampleCount, channels, channelSpeakerArray, channelFillMask);
+	}
+}
+
+void ts3plugin_onCustom3dRolloffCalculationWaveEvent(uint64 serverConnectionHandlerID, uint64 waveHandle, float distance, float* volume) {
 }
 
 /*
@@ -842,12 +2070,46 @@ void ts3plugin_onMenuItemEvent(uint64 serverConnectionHandlerID, enum PluginMenu
 		case PLUGIN_MENU_TYPE_GLOBAL:
 			/* Global menu item was triggered. selectedItemID is unused and set to zero. */
 			switch(menuItemID) {
-				case MENU_ID_REFRESH_CONFIGURATION:
+				case MENU_ID_REFRESH_CONFIGURATION: {
 					/* Menu global 2 was triggered */
-					if (ChannelHasConfig) {
-						dpar_updateFromRemoteConfiguration(serverConnectionHandlerID);
+					SessionRef session = Sessions.find(serverConnectionHandlerID);
+					if (session != NULL && session->channelHasConfig) {
+						dpar_queueConfigRefresh(serverConnectionHandlerID);
 					}
 					break;
+				}
+				case MENU_ID_TOGGLE_SPATIALIZER:
+				{
+					const bool enabled = !SpatializerEnabled.load();
+					SpatializerEnabled = enabled;
+					ts3Functions.logMessage(enabled ? "Binaural spatializer enabled" : "Binaural spatializer disabled", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+					break;
+				}
+				case MENU_ID_TOGGLE_PROXIMITY_WHISPER:
+				{
+					const bool enabled = !ProximityWhisper.load();
+					ProximityWhisper = enabled;
+					if (!enabled) {
+						// Every connection goes back to talking to its whole channel
+						Sessions.forEach([](ServerSession& session) {
+							dpar_clearWhisperList(session.serverConnectionHandlerID);
+						});
+					}
+					ts3Functions.logMessage(enabled ? "Proximity whisper enabled" : "Proximity whisper disabled", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+					break;
+				}
+				case MENU_ID_TOGGLE_AUTO_MUTE:
+				{
+					const bool enabled = !AutoMute.load();
+					AutoMute = enabled;
+					if (!enabled) {
+						Sessions.forEach([](ServerSession& session) {
+							dpar_releaseMutes(session.serverConnectionHandlerID);
+						});
+					}
+					ts3Functions.logMessage(enabled ? "Auto-mute enabled" : "Auto-mute disabled", LogLevel_INFO, "DPAR", serverConnectionHandlerID);
+					break;
+				}
 				default:
 					break;
 			}
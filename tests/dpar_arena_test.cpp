@@ -0,0 +1,159 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "dpar_test.hpp"
+#include "dpar_arena.hpp"
+#include "dpar_audibility.hpp"
+#include "dpar_budget.hpp"
+#include "dpar_players.hpp"
+#include "dpar_refresh.hpp"
+
+/********************************** Counting allocator *********************************/
+
+// Every global new in the test program goes through here, counted while Counting is set
+static std::atomic<bool> Counting(false);
+static std::atomic<size_t> HeapAllocations(0);
+
+static void* dpar_countedAlloc(size_t size, size_t alignment) {
+	if (Counting.load(std::memory_order_relaxed)) {
+		HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Over allocated so any alignment fits, the block malloc returned is kept just in front for the free
+	void* block = malloc(size + alignment + sizeof(void*));
+	if (block == NULL) {
+		throw std::bad_alloc();
+	}
+	uintptr_t p = ((uintptr_t)block + sizeof(void*) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	((void**)p)[-1] = block;
+	return (void*)p;
+}
+
+static void dpar_countedFree(void* p) {
+	if (p != NULL) {
+		free(((void**)p)[-1]);
+	}
+}
+
+void* operator new(size_t size) { return dpar_countedAlloc(size, alignof(std::max_align_t)); }
+void* operator new[](size_t size) { return dpar_countedAlloc(size, alignof(std::max_align_t)); }
+void* operator new(size_t size, std::align_val_t alignment) { return dpar_countedAlloc(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return dpar_countedAlloc(size, (size_t)alignment); }
+void operator delete(void* p) noexcept { dpar_countedFree(p); }
+void operator delete[](void* p) noexcept { dpar_countedFree(p); }
+void operator delete(void* p, size_t) noexcept { dpar_countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { dpar_countedFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { dpar_countedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { dpar_countedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { dpar_countedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { dpar_countedFree(p); }
+
+/********************************** Tests *********************************/
+
+#define DPAR_TEST_PLAYERS 300
+
+/* What a session keeps from tick to tick for the arena backed part of applying positions */
+struct ApplyState {
+	TickArena arena;
+	PlayerStore players;
+	RefreshScheduler refresh;
+	AudibilityMask audibility;
+	TalkerBudget budget;
+
+	ApplyState() : arena(DPAR_ARENA_INITIAL_BYTES) {}
+};
+
+// The scratch side of dpar_applyPositions for one tick. Everyone, listener included, walks the same way so the
+// budget's ranking holds, as in a steady channel. A new talker ranking out of budget allocates its bench entry
+static void dpar_simulateTick(ApplyState& state, int tickNumber) {
+	std::pmr::memory_resource* tick = state.arena.begin();
+	const float step = (float)tickNumber * 0.1f;
+
+	state.players.clear();
+	for (int i = 0; i < DPAR_TEST_PLAYERS; ++i) {
+		state.players.add((anyID)(i + 1), (float)(i % 40) * 3.0f, 64.0f, (float)(i / 40) * 3.0f + step, 0.0f, i % 5 == 0 ? 99999 : 1 + i % 3, true);
+	}
+
+	ChannelSet hears(tick);
+	hears.insert(1);
+	hears.insert(2);
+	hears.insert(99999);
+
+	state.players.transform();
+	std::pmr::vector<uint8_t> audible(tick);
+	state.players.audibleMask(hears, audible);
+
+	TS3_VECTOR center;
+	center.x = -30.0f;
+	center.y = 64.0f;
+	center.z = 10.0f + step;
+	state.players.measure(center);
+
+	std::pmr::vector<uint8_t> send(tick);
+	state.refresh.plan(state.players, audible, 60.0f, 50, send);
+
+	std::pmr::vector<anyID> silenced(tick);
+	std::pmr::vector<uint8_t> inRange(tick);
+	state.players.rangeMask(60.0f, inRange);
+	std::pmr::vector<std::pair<anyID, float>> talkerDistances(tick);
+	for (size_t i = 0; i < state.players.size(); ++i) {
+		if (!audible[i]) {
+			silenced.push_back(state.players.client(i));
+			continue;
+		}
+		talkerDistances.push_back(std::make_pair(state.players.client(i), state.players.distance(i)));
+	}
+	state.audibility.update(silenced);
+	state.budget.select(talkerDistances, 10, true, std::chrono::steady_clock::now());
+}
+
+DPAR_TEST(applyScratchSettlesOffTheHeap) {
+	ApplyState* state = new ApplyState();
+	for (int i = 0; i < DPAR_TEST_PLAYERS; ++i) {
+		state->budget.setTalking((anyID)(i + 1), true);
+	}
+
+	// The first ticks size the arena and the arrays kept between ticks
+	for (int i = 0; i < 10; ++i) {
+		dpar_simulateTick(*state, i);
+	}
+
+	HeapAllocations = 0;
+	Counting = true;
+	for (int i = 10; i < 200; ++i) {
+		dpar_simulateTick(*state, i);
+	}
+	Counting = false;
+
+	DPAR_CHECK(HeapAllocations.load() == 0);
+	DPAR_CHECK(state->arena.lastTickSpills() == 0);
+	delete state;
+}
+
+DPAR_TEST(arenaGrowsAfterASpill) {
+	TickArena arena(64);
+
+	std::pmr::memory_resource* tick = arena.begin();
+	std::pmr::vector<float> big(tick);
+	big.resize(4096);
+	big.clear();
+	big.shrink_to_fit();
+
+	// The spill is counted, then the next tick fits in the grown buffer
+	tick = arena.begin();
+	DPAR_CHECK(arena.lastTickSpills() > 0);
+	DPAR_CHECK(arena.spills() > 0);
+
+	std::pmr::vector<float> again(tick);
+	again.resize(4096);
+	arena.begin();
+	DPAR_CHECK(arena.lastTickSpills() == 0);
+}
@@ -0,0 +1,61 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <limits.h>
+#include "dpar_test.hpp"
+#include "dpar_audibility.hpp"
+#include "dpar_players.hpp"
+
+DPAR_TEST(channelSetHoldsIdsInRange) {
+	ChannelSet hears;
+	hears.insert(0);
+	hears.insert(63);
+	hears.insert(64);
+	hears.insert(DPAR_MAX_GAME_CHANNELS - 1);
+
+	DPAR_CHECK(hears.contains(0));
+	DPAR_CHECK(hears.contains(63));
+	DPAR_CHECK(hears.contains(64));
+	DPAR_CHECK(hears.contains(DPAR_MAX_GAME_CHANNELS - 1));
+	DPAR_CHECK(!hears.contains(1));
+	DPAR_CHECK(!hears.contains(65));
+}
+
+DPAR_TEST(channelSetHoldsIdsOutOfRange) {
+	ChannelSet hears;
+	hears.insert(-1);
+	hears.insert(DPAR_MAX_GAME_CHANNELS);
+	hears.insert(1000000);
+	hears.insert(INT_MIN);
+
+	DPAR_CHECK(hears.contains(-1));
+	DPAR_CHECK(hears.contains(DPAR_MAX_GAME_CHANNELS));
+	DPAR_CHECK(hears.contains(1000000));
+	DPAR_CHECK(hears.contains(INT_MIN));
+	DPAR_CHECK(!hears.contains(-2));
+	DPAR_CHECK(!hears.contains(DPAR_MAX_GAME_CHANNELS + 1));
+	DPAR_CHECK(!hears.contains(0));
+
+	hears.clear();
+	DPAR_CHECK(!hears.contains(-1));
+	DPAR_CHECK(!hears.contains(1000000));
+}
+
+DPAR_TEST(playersOnOutOfRangeChannelsAreAudible) {
+	PlayerStore players;
+	players.add(1, 0.0f, 0.0f, 0.0f, 0.0f, 70000, true);
+	players.add(2, 0.0f, 0.0f, 0.0f, 0.0f, -5, true);
+	players.add(3, 0.0f, 0.0f, 0.0f, 0.0f, 12, true);
+
+	ChannelSet hears;
+	hears.insert(70000);
+	hears.insert(-5);
+
+	std::pmr::vector<uint8_t> audible;
+	players.audibleMask(hears, audible);
+	DPAR_CHECK(audible.size() == 3);
+	DPAR_CHECK(audible[0] == 1);
+	DPAR_CHECK(audible[1] == 1);
+	DPAR_CHECK(audible[2] == 0);
+}
@@ -0,0 +1,144 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include <cmath>
+#include "dpar_grid.hpp"
+
+// Cell coordinates are packed 21 bits an axis, plenty for any world at cutoff sized cells
+#define DPAR_GRID_AXIS_BITS 21
+#define DPAR_GRID_AXIS_BIAS (1 << (DPAR_GRID_AXIS_BITS - 1))
+#define DPAR_GRID_AXIS_MASK ((1 << DPAR_GRID_AXIS_BITS) - 1)
+
+static int64_t dpar_packCell(int64_t x, int64_t y, int64_t z) {
+	return (((x + DPAR_GRID_AXIS_BIAS) & DPAR_GRID_AXIS_MASK) << (2 * DPAR_GRID_AXIS_BITS))
+		| (((y + DPAR_GRID_AXIS_BIAS) & DPAR_GRID_AXIS_MASK) << DPAR_GRID_AXIS_BITS)
+		| ((z + DPAR_GRID_AXIS_BIAS) & DPAR_GRID_AXIS_MASK);
+}
+
+SpatialGrid::SpatialGrid(float cellSize) : cellSize(cellSize > 0.0f ? cellSize : 1.0f), generation(0) {
+}
+
+int64_t SpatialGrid::cellOf(const TS3_VECTOR& position) const {
+	return dpar_packCell((int64_t)std::floor(position.x / cellSize), (int64_t)std::floor(position.y / cellSize), (int64_t)std::floor(position.z / cellSize));
+}
+
+void SpatialGrid::unlink(anyID clientID, int64_t cell) {
+	std::unordered_map<int64_t, std::vector<anyID>>::iterator bucket = cells.find(cell);
+	if (bucket == cells.end()) {
+		return;
+	}
+
+	std::vector<anyID>& members = bucket->second;
+	for (size_t i = 0; i < members.size(); ++i) {
+		if (members[i] == clientID) {
+			members[i] = members.back();
+			members.pop_back();
+			break;
+		}
+	}
+	if (members.empty()) {
+		cells.erase(bucket);
+	}
+}
+
+void SpatialGrid::setCellSize(float size) {
+	if (size <= 0.0f || size == cellSize) {
+		return;
+	}
+
+	cellSize = size;
+	cells.clear();
+	for (std::unordered_map<anyID, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+		it->second.cell = cellOf(it->second.position);
+		cells[it->second.cell].push_back(it->first);
+	}
+}
+
+void SpatialGrid::beginSnapshot() {
+	++generation;
+}
+
+void SpatialGrid::update(anyID clientID, const TS3_VECTOR& position) {
+	const int64_t cell = cellOf(position);
+
+	std::unordered_map<anyID, Entry>::iterator it = entries.find(clientID);
+	if (it == entries.end()) {
+		Entry entry;
+		entry.position = position;
+		entry.cell = cell;
+		entry.generation = generation;
+		entries[clientID] = entry;
+		cells[cell].push_back(clientID);
+		return;
+	}
+
+	// Most clients stay in the same cell from one snapshot to the next
+	if (it->second.cell != cell) {
+		unlink(clientID, it->second.cell);
+		cells[cell].push_back(clientID);
+		it->second.cell = cell;
+	}
+	it->second.position = position;
+	it->second.generation = generation;
+}
+
+void SpatialGrid::endSnapshot() {
+	for (std::unordered_map<anyID, Entry>::iterator it = entries.begin(); it != entries.end();) {
+		if (it->second.generation == generation) {
+			++it;
+			continue;
+		}
+		unlink(it->first, it->second.cell);
+		it = entries.erase(it);
+	}
+}
+
+void SpatialGrid::remove(anyID clientID) {
+	std::unordered_map<anyID, Entry>::iterator it = entries.find(clientID);
+	if (it != entries.end()) {
+		unlink(clientID, it->second.cell);
+		entries.erase(it);
+	}
+}
+
+void SpatialGrid::clear() {
+	entries.clear();
+	cells.clear();
+}
+
+void SpatialGrid::query(const TS3_VECTOR& center, float radius, std::pmr::vector<std::pair<anyID, float>>& found) const {
+	const int64_t minX = (int64_t)std::floor((center.x - radius) / cellSize);
+	const int64_t maxX = (int64_t)std::floor((center.x + radius) / cellSize);
+	const int64_t minY = (int64_t)std::floor((center.y - radius) / cellSize);
+	const int64_t maxY = (int64_t)std::floor((center.y + radius) / cellSize);
+	const int64_t minZ = (int64_t)std::floor((center.z - radius) / cellSize);
+	const int64_t maxZ = (int64_t)std::floor((center.z + radius) / cellSize);
+	const float radiusSquared = radius * radius;
+
+	for (int64_t x = minX; x <= maxX; ++x) {
+		for (int64_t y = minY; y <= maxY; ++y) {
+			for (int64_t z = minZ; z <= maxZ; ++z) {
+				std::unordered_map<int64_t, std::vector<anyID>>::const_iterator bucket = cells.find(dpar_packCell(x, y, z));
+				if (bucket == cells.end()) {
+					continue;
+				}
+
+				for (size_t i = 0; i < bucket->second.size(); ++i) {
+					const TS3_VECTOR& p = entries.find(bucket->second[i])->second.position;
+					const float dx = p.x - center.x;
+					const float dy = p.y - center.y;
+					const float dz = p.z - center.z;
+					const float distanceSquared = dx * dx + dy * dy + dz * dz;
+					if (distanceSquared <= radiusSquared) {
+						found.push_back(std::make_pair(bucket->second[i], std::sqrt(distanceSquared)));
+					}
+				}
+			}
+		}
+	}
+}
+
+size_t SpatialGrid::size() const {
+	return entries.size();
+}
@@ -0,0 +1,55 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Uniform grid over client positions. Each snapshot only moves the clients that changed
+ * cell, and "who is within R of here" looks at the handful of cells around the point
+ * instead of every client in the channel. The plugin doesn't use it since PlayerStore's linear
+ * range mask came out faster, it's kept for dpar_grid_bench.cpp to go on measuring against
+ */
+
+#ifndef DPAR_GRID_H
+#define DPAR_GRID_H
+
+#include <memory_resource>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+class SpatialGrid {
+	struct Entry {
+		TS3_VECTOR position;
+		int64_t cell;
+		uint32_t generation;  // Snapshot that last placed the client
+	};
+
+	float cellSize;
+	uint32_t generation;
+	std::unordered_map<anyID, Entry> entries;
+	std::unordered_map<int64_t, std::vector<anyID>> cells;
+
+	int64_t cellOf(const TS3_VECTOR& position) const;
+	void unlink(anyID clientID, int64_t cell);
+
+	public:
+		explicit SpatialGrid(float cellSize);
+
+		// Cells work best about the size of the usual query radius, changing it re-buckets everyone
+		void setCellSize(float size);
+
+		// Snapshots are bracketed so clients missing from one are dropped when it ends
+		void beginSnapshot();
+		void update(anyID clientID, const TS3_VECTOR& position);
+		void endSnapshot();
+
+		void remove(anyID clientID);
+		void clear();
+
+		// Appends every client within radius of center along with its distance from it
+		void query(const TS3_VECTOR& center, float radius, std::pmr::vector<std::pair<anyID, float>>& found) const;
+
+		size_t size() const;
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Times PlayerStore's measure and range mask, what dpar_applyPositions runs every tick, against
+ * keeping the same crowd in a SpatialGrid and querying that. Prints the numbers for each crowd size
+ * and checks both agree on who is in range
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <memory_resource>
+#include <random>
+#include <utility>
+#include <vector>
+#include "dpar_test.hpp"
+#include "dpar_grid.hpp"
+#include "dpar_players.hpp"
+
+#define DPAR_BENCH_TICKS 200
+#define DPAR_BENCH_CUTOFF 60.0f
+
+// How far a player can sit from the radius before the two sides may round it differently
+#define DPAR_BENCH_EDGE 0.001f
+
+// A crowd walking about a square world sized to keep around 30 players in each cutoff sized cell, listening
+// from a different player each tick. Returns how many times the grid and the store disagreed on who is in range
+static int dpar_benchGrid(int playerCount) {
+	const float radius = DPAR_BENCH_CUTOFF * 1.25f;
+	const float world = DPAR_BENCH_CUTOFF * sqrtf((float)playerCount / 30.0f + 1.0f);
+
+	std::mt19937 random(12345);
+	std::uniform_real_distribution<float> place(0.0f, world);
+	std::uniform_real_distribution<float> step(-0.5f, 0.5f);
+
+	std::vector<float> xs(playerCount);
+	std::vector<float> zs(playerCount);
+	for (int i = 0; i < playerCount; ++i) {
+		xs[i] = place(random);
+		zs[i] = place(random);
+	}
+
+	PlayerStore players;
+	SpatialGrid grid(DPAR_BENCH_CUTOFF);
+	std::pmr::vector<uint8_t> mask;
+	std::pmr::vector<std::pair<anyID, float>> found;
+	std::vector<uint8_t> inGrid(playerCount);
+	std::chrono::steady_clock::duration scanTime(0);
+	std::chrono::steady_clock::duration updateTime(0);
+	std::chrono::steady_clock::duration queryTime(0);
+	size_t hits = 0;
+	int mismatches = 0;
+
+	for (int t = 0; t < DPAR_BENCH_TICKS; ++t) {
+		players.clear();
+		for (int i = 0; i < playerCount; ++i) {
+			xs[i] += step(random);
+			zs[i] += step(random);
+			players.add((anyID)(i + 1), xs[i], 64.0f, zs[i], 0.0f, 0, true);
+		}
+		players.transform();
+
+		const TS3_VECTOR listener = players.position(t % playerCount);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		players.measure(listener);
+		players.rangeMask(radius, mask);
+		scanTime += std::chrono::steady_clock::now() - start;
+
+		// The grid is handed the same TeamSpeak space positions the store measured
+		start = std::chrono::steady_clock::now();
+		grid.beginSnapshot();
+		for (int i = 0; i < playerCount; ++i) {
+			grid.update(players.client(i), players.position(i));
+		}
+		grid.endSnapshot();
+		updateTime += std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+		found.clear();
+		grid.query(listener, radius, found);
+		queryTime += std::chrono::steady_clock::now() - start;
+
+		std::fill(inGrid.begin(), inGrid.end(), 0);
+		for (size_t f = 0; f < found.size(); ++f) {
+			inGrid[found[f].first - 1] = 1;
+		}
+		for (int i = 0; i < playerCount; ++i) {
+			hits += mask[i];
+			if ((mask[i] != 0) != (inGrid[i] != 0) && fabsf(players.distance(i) - radius) > DPAR_BENCH_EDGE) {
+				++mismatches;
+			}
+		}
+	}
+
+	printf("      %d players: measure + range mask %.2fus, grid update %.2fus + query %.2fus per tick, %.1f in range\n",
+		playerCount,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(scanTime).count() / 1000.0 / DPAR_BENCH_TICKS,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(updateTime).count() / 1000.0 / DPAR_BENCH_TICKS,
+		std::chrono::duration_cast<std::chrono::nanoseconds>(queryTime).count() / 1000.0 / DPAR_BENCH_TICKS,
+		(double)hits / DPAR_BENCH_TICKS);
+	return mismatches;
+}
+
+// The numbers behind placing players with a linear range mask rather than a grid. The grid has to be
+// kept up to date every tick whoever asks, so it only pays if its query saves more than that costs
+DPAR_TEST(rangeMaskAgainstGrid) {
+	DPAR_CHECK(dpar_benchGrid(100) == 0);
+	DPAR_CHECK(dpar_benchGrid(1000) == 0);
+	DPAR_CHECK(dpar_benchGrid(5000) == 0);
+}
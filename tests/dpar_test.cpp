@@ -0,0 +1,33 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ */
+
+#include "dpar_test.hpp"
+
+int DparTestFailures = 0;
+
+// Registered from static initialisers, so a plain list rather than anything needing construction first
+static DparTest* Tests = NULL;
+
+DparTest::DparTest(const char* name, DparTestFunction run) : name(name), run(run), next(Tests) {
+	Tests = this;
+}
+
+int main() {
+	int failedTests = 0;
+	int ran = 0;
+	for (DparTest* test = Tests; test != NULL; test = test->next) {
+		const int before = DparTestFailures;
+		test->run();
+		++ran;
+
+		const bool passed = DparTestFailures == before;
+		if (!passed) {
+			++failedTests;
+		}
+		printf("%s %s\n", passed ? "ok    " : "FAILED", test->name);
+	}
+
+	printf("%d of %d tests passed\n", ran - failedTests, ran);
+	return failedTests == 0 ? 0 : 1;
+}
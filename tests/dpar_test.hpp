@@ -0,0 +1,40 @@
+/*
+ * Darke Positional Audio Receiver for Teamspeak 3
+ *
+ * Small test harness for the parts of the plugin that run without TeamSpeak or a reporting
+ * server. Every DPAR_TEST registers itself and dpar_test.cpp runs them all, failing the
+ * CPP-PAR-Tests build if any check doesn't hold
+ */
+
+#ifndef DPAR_TEST_H
+#define DPAR_TEST_H
+
+#include <stdio.h>
+
+typedef void (*DparTestFunction)();
+
+struct DparTest {
+	const char* name;
+	DparTestFunction run;
+	DparTest* next;
+
+	DparTest(const char* name, DparTestFunction run);
+};
+
+// Failed checks so far, a failing check is reported and the test carries on
+extern int DparTestFailures;
+
+#define DPAR_TEST(name) \
+	static void name(); \
+	static DparTest name##Registration(#name, &name); \
+	static void name()
+
+#define DPAR_CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++DparTestFailures; \
+		} \
+	} while (0)
+
+#endif